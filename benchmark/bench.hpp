@@ -0,0 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace bench {
+// Runs 'body' 'repeat' times and returns the fastest run in nanoseconds.
+template <typename Body>
+double measure(Body body, int repeat = 50) {
+    double best = 1e300;
+    for(int i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        best     = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best;
+}
+// The same, with 'prepare' run before each run of 'body' and left out of the time.
+template <typename Prepare, typename Body>
+double measure_prepared(Prepare prepare, Body body, int repeat = 50) {
+    double best = 1e300;
+    for(int i = 0; i < repeat; ++i) {
+        prepare();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        best     = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best;
+}
+// Keeps the compiler from dropping the computation of 'value'.
+template <typename T>
+void keep(T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+inline std::mt19937& random_engine() {
+    static std::mt19937 engine(1);
+    return engine;
+}
+} // namespace bench
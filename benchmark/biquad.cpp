@@ -0,0 +1,73 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "bench.hpp"
+#include "biquad.hpp"
+
+namespace {
+using namespace eq;
+
+constexpr n_frames frames = 4096;
+
+std::vector<Band> make_bands() {
+    std::vector<Band> bands;
+    for(f64 frequency = 31.25; frequency < 20000; frequency *= 2) {
+        bands.emplace_back(Band{FilterType::PEAKING, frequency, frequency < 1000 ? 4.0 : -3.0, 1.414});
+    }
+    return bands;
+}
+// Scalar transposed direct form II, in the same order of operations as the kernels.
+void reference(f32* pcm, n_frames frames, u32 channels, const Design& design, std::vector<f64>& states) {
+    for(n_frames f = 0; f < frames; ++f) {
+        for(u32 c = 0; c < channels; ++c) {
+            f64 x = static_cast<f64>(pcm[f * channels + c]) * design.preamp;
+            for(size_t i = 0; i < design.count; ++i) {
+                const auto& s  = design.sections[i];
+                auto&       s1 = states[(i * 2) * channels + c];
+                auto&       s2 = states[(i * 2 + 1) * channels + c];
+                const auto  y  = s.b0 * x + s1;
+                s1             = s.b1 * x - s.a1 * y + s2;
+                s2             = s.b2 * x - s.a2 * y;
+                x              = y;
+            }
+            pcm[f * channels + c] = x;
+        }
+    }
+}
+} // namespace
+
+// Reports the load of Cascade, a 10 band equalizer, as a share of one core. Fails if it differs from the scalar reference.
+int main() {
+    const auto bands  = make_bands();
+    int        result = 0;
+    std::printf("%-14s %12s %12s\n", "", "ns/frame", "% of a core");
+    for(u32 rate : {48000, 192000}) {
+        for(u32 channels : {2, 8}) {
+            const auto       design = eq::design(bands, -4, rate);
+            std::vector<f32> input(frames * channels);
+            for(n_frames f = 0; f < frames; ++f) {
+                for(u32 c = 0; c < channels; ++c) input[f * channels + c] = 0.5 * std::sin(2 * M_PI * 440 * f / rate + c);
+            }
+            Cascade cascade;
+            auto    pcm = input;
+            auto    ns  = bench::measure([&] {
+                cascade.process(pcm.data(), frames, channels, design);
+                bench::keep(pcm);
+            });
+            std::printf("%6u Hz %2uch %12.3f %12.3f\n", rate, channels, ns / frames, 100 * ns / (1e9 * frames / rate));
+
+            Cascade          vector;
+            std::vector<f64> states(max_bands * 2 * channels);
+            auto             expected = input;
+            pcm                       = input;
+            vector.process(pcm.data(), frames, channels, design);
+            reference(expected.data(), frames, channels, design, states);
+            if(pcm != expected) {
+                std::printf("result differs from the scalar reference.\n");
+                result = 1;
+            }
+        }
+    }
+    return result;
+}
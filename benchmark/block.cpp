@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <vector>
+
+#include <module_forward.hpp>
+#include <plugin.hpp>
+#include <remixer.hpp>
+#include <resampler.hpp>
+
+#include "bench.hpp"
+#include "biquad.hpp"
+
+namespace {
+using namespace boxten;
+
+constexpr u32 channels      = 2;
+constexpr u32 sampling_rate = 48000;
+
+void apply_gain(f32* pcm, n_frames frames) {
+    for(n_frames i = 0; i < frames * channels; ++i) pcm[i] *= 0.5f;
+}
+// A trivial in-place processor, which takes whole blocks.
+class BlockGain : public SoundProcessor {
+  public:
+    bool modify_packet(PCMPacketUnit& packet) override {
+        apply_gain(reinterpret_cast<f32*>(packet.pcm.data()), packet.get_frames());
+        return true;
+    }
+    bool modify_block(PCMBlock& block) override {
+        apply_gain(reinterpret_cast<f32*>(block.pcm), block.frames);
+        return true;
+    }
+    bool is_in_place() override {
+        return true;
+    }
+    BlockGain(void* param) : SoundProcessor(param) {}
+};
+// The same processor without modify_block(). Blocks go through the default implementation.
+class PacketGain : public SoundProcessor {
+  public:
+    bool modify_packet(PCMPacketUnit& packet) override {
+        apply_gain(reinterpret_cast<f32*>(packet.pcm.data()), packet.get_frames());
+        return true;
+    }
+    bool is_in_place() override {
+        return true;
+    }
+    PacketGain(void* param) : SoundProcessor(param) {}
+};
+// The filters of the equalizer module, with a 10 band graphic setting. 'overrides_block' selects whether modify_block() is overridden.
+template <bool overrides_block>
+class Equalizer : public SoundProcessor {
+  private:
+    eq::Cascade cascade;
+    eq::Design  design;
+
+  public:
+    bool modify_packet(PCMPacketUnit& packet) override {
+        cascade.process(reinterpret_cast<f32*>(packet.pcm.data()), packet.get_frames(), channels, design);
+        return true;
+    }
+    bool modify_block(PCMBlock& block) override {
+        if(!overrides_block) return SoundProcessor::modify_block(block);
+        cascade.process(reinterpret_cast<f32*>(block.pcm), block.frames, channels, design);
+        return true;
+    }
+    bool is_in_place() override {
+        return true;
+    }
+    Equalizer(void* param) : SoundProcessor(param) {
+        std::vector<eq::Band> bands;
+        for(f64 frequency = 31.25; frequency < 20000; frequency *= 2) {
+            bands.emplace_back(eq::Band{eq::FilterType::PEAKING, frequency, frequency < 1000 ? 4.0 : -3.0, 1.414});
+        }
+        design = eq::design(bands, -4, sampling_rate);
+    }
+};
+
+ComponentConstructionParam make_param(const char* name) {
+    return ComponentConstructionParam("benchmark", ComponentInfo(name, COMPONENT_TYPE::SOUND_PROCESSOR, nullptr, nullptr), [] {});
+}
+// Returns the cost per frame of 'body', which processes 'frames' frames.
+template <typename Body>
+f64 per_frame(n_frames frames, Body body) {
+    return bench::measure([&] {
+        for(int i = 0; i < 100; ++i) body();
+    }) / 100 / frames;
+}
+f64 measure(SoundProcessor& processor, n_frames frames) {
+    PCMPacketUnit packet;
+    packet.format                = PCMFormat{native_f32, channels, sampling_rate};
+    packet.original_frame_pos[0] = 0;
+    packet.original_frame_pos[1] = frames - 1;
+    packet.pcm.resize(frames * channels * sizeof(f32));
+    PCMBlock block{packet.format, {0, frames - 1}, packet.pcm.data(), frames, &packet};
+    return per_frame(frames, [&] {
+        processor.modify_block(block);
+        bench::keep(packet);
+    });
+}
+// 44.1 kHz to 48 kHz with the default preset, per input frame.
+f64 measure_resampler(n_frames frames) {
+    Resampler resampler;
+    resampler.configure(44100, sampling_rate, channels, ResamplerQuality::MEDIUM);
+    std::vector<f32> input(frames * channels);
+    std::vector<f32> output(resampler.max_output_frames(frames) * channels);
+    return per_frame(frames, [&] {
+        resampler.process(input.data(), frames, output.data());
+        bench::keep(output);
+    });
+}
+// 5.1 to stereo with the default matrix.
+f64 measure_remixer(n_frames frames) {
+    constexpr u32 inputs = 6;
+    Remixer       remixer;
+    remixer.configure(inputs, channels, {});
+    std::vector<f32> input(frames * inputs);
+    std::vector<f32> output(frames * channels);
+    return per_frame(frames, [&] {
+        remixer.process(input.data(), frames, output.data());
+        bench::keep(output);
+    });
+}
+} // namespace
+
+// Compares the cost per frame of SoundProcessor::modify_block() overridden by a processor,
+// with its default implementation which splits blocks into packets for modify_packet().
+// The converters which the engine inserts between stages are timed at the same sizes of blocks.
+int main() {
+    auto             block_param     = make_param("block gain");
+    auto             packet_param    = make_param("packet gain");
+    auto             block_eq_param  = make_param("block eq");
+    auto             packet_eq_param = make_param("packet eq");
+    BlockGain        block_gain(&block_param);
+    PacketGain       packet_gain(&packet_param);
+    Equalizer<true>  block_eq(&block_eq_param);
+    Equalizer<false> packet_eq(&packet_eq_param);
+    std::printf("%-8s %34s %34s %12s %12s\n", "", "gain", "eq", "resampler", "remixer");
+    std::printf("%-8s %16s %17s %16s %17s %12s %12s\n", "frames", "override ns/fr", "fallback ns/fr", "override ns/fr", "fallback ns/fr", "ns/fr", "ns/fr");
+    for(n_frames frames : {PCMPACKET_PERIOD, PCMPACKET_PERIOD * 4, PCMPACKET_PERIOD * 16}) {
+        std::printf("%-8lu %16.3f %17.3f %16.3f %17.3f %12.3f %12.3f\n", static_cast<unsigned long>(frames),
+                    measure(block_gain, frames), measure(packet_gain, frames), measure(block_eq, frames), measure(packet_eq, frames),
+                    measure_resampler(frames), measure_remixer(frames));
+    }
+    return 0;
+}
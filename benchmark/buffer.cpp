@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <buffer.hpp>
+
+#include "bench.hpp"
+
+namespace {
+using namespace boxten;
+
+constexpr n_frames packets       = 32; // the default buffer holds 32 periods.
+constexpr n_frames packet_frames = PCMPACKET_PERIOD;
+constexpr n_frames period        = 441; // frames the output takes at once. not aligned to packets.
+constexpr u32      channels      = 2;
+constexpr size_t   frame_bytes   = channels * 2;
+
+void fill(Buffer& buffer) {
+    for(n_frames i = 0; i < packets; ++i) {
+        PCMPacketUnit unit;
+        unit.format                = PCMFormat{SampleType::s16_le, channels, 44100};
+        unit.original_frame_pos[0] = i * packet_frames;
+        unit.original_frame_pos[1] = unit.original_frame_pos[0] + packet_frames - 1;
+        unit.pcm.resize(packet_frames * frame_bytes);
+        buffer.append(std::move(unit));
+    }
+}
+} // namespace
+
+// Moves packets through Buffer, taking them out with cut() and with read(). Filling the buffer is not timed.
+// Reports the time per output frame, and how many times the buffer copied each frame between the decoder and the output.
+// cut() copies only the frames of packets which it splits, at most once. read() must not copy at all.
+int main() {
+    Buffer          buffer;
+    std::vector<u8> output(period * frame_bytes);
+    const auto      frames  = packets * packet_frames / period * period;
+    const auto      prepare = [&] {
+        buffer.clear();
+        fill(buffer);
+    };
+
+    auto last   = buffer.get_statistics();
+    auto report = [&](const char* name, double ns) {
+        auto       statistics = buffer.get_statistics();
+        auto       copied     = statistics.copied_frames - last.copied_frames;
+        auto       output     = statistics.output_frames - last.output_frames;
+        const auto copies     = static_cast<double>(copied) / output;
+        std::printf("%-6s %8.3f ns/frame, %5.3f copies/frame, %5.2f bytes copied/frame\n", name, ns / frames, copies, copies * frame_bytes);
+        last = statistics;
+        return copies;
+    };
+    auto cut = bench::measure_prepared(prepare, [&] {
+        for(n_frames done = 0; done < frames; done += period) {
+            auto packet = buffer.cut(period);
+            bench::keep(packet);
+        }
+    });
+    int result = 0;
+    if(report("cut", cut) > 1) {
+        std::printf("cut() copied frames more than once.\n");
+        result = 1;
+    }
+    auto read = bench::measure_prepared(prepare, [&] {
+        for(n_frames done = 0; done < frames; done += period) {
+            auto destination = output.data();
+            buffer.read(period, [&](const PCMView& view) {
+                std::memcpy(destination, view.pcm, view.frames * frame_bytes);
+                destination += view.frames * frame_bytes;
+                return view.frames;
+            });
+            bench::keep(output);
+        }
+    });
+    if(report("read", read) != 0) {
+        std::printf("read() copied frames.\n");
+        result = 1;
+    }
+    buffer.clear();
+    return result;
+}
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <malloc.h>
+#include <new>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <configuration.hpp>
+#include <module_forward.hpp>
+#include <pipeline.hpp>
+#include <worker_internal.hpp>
+
+namespace {
+// Freed memory is filled with a pattern, so that a chain used after it is freed calls processors through broken pointers.
+void poison_and_free(void* pointer) {
+    if(pointer != nullptr) std::memset(pointer, 0xa5, malloc_usable_size(pointer));
+    std::free(pointer);
+}
+} // namespace
+void* operator new(size_t bytes) {
+    if(auto pointer = std::malloc(bytes == 0 ? 1 : bytes)) return pointer;
+    throw std::bad_alloc();
+}
+void operator delete(void* pointer) noexcept {
+    poison_and_free(pointer);
+}
+void operator delete(void* pointer, size_t) noexcept {
+    poison_and_free(pointer);
+}
+
+namespace {
+using namespace boxten;
+
+constexpr u32      channels = 2;
+constexpr n_frames frames   = 64;
+constexpr int      packets  = 20000;
+
+// Adds a constant to every sample. Counts the calls which overlap another call of the same processor.
+class Add : public SoundProcessor {
+  private:
+    f32              value;
+    std::atomic<int> busy = 0;
+
+  public:
+    std::atomic<int> overlaps = 0;
+
+    bool modify_packet(PCMPacketUnit& packet) override {
+        if(busy.fetch_add(1) != 0) overlaps++;
+        auto pcm = reinterpret_cast<f32*>(packet.pcm.data());
+        for(size_t i = 0; i < packet.pcm.size() / sizeof(f32); ++i) pcm[i] += value;
+        for(volatile int i = 0; i < 2000; i = i + 1) {} // widens the window of overlaps.
+        busy--;
+        return true;
+    }
+    FormatCapabilities get_capabilities() override {
+        FormatCapabilities capabilities;
+        capabilities.sample_types = {native_f32};
+        return capabilities;
+    }
+    bool is_in_place() override {
+        return true;
+    }
+    Add(void* param, f32 value) : SoundProcessor(param), value(value) {}
+};
+
+ComponentConstructionParam make_param(const char* name) {
+    return ComponentConstructionParam("benchmark", ComponentInfo(name, COMPONENT_TYPE::SOUND_PROCESSOR, nullptr, nullptr), [] {});
+}
+struct Result {
+    size_t threads  = 0; // DSP threads which ran.
+    int    swaps    = 0;
+    int    overlaps = 0;
+    int    mixed    = 0; // packets which went through stages of more than one chain.
+    f64    max_us   = 0; // the longest process(). it includes the waits for the pipeline to drain on swaps.
+};
+// Passes packets of zeros through the pipeline, while another thread swaps the chain as fast as it can.
+// Each chain adds a distinct sum, so that a packet which ran through parts of two chains is caught in the sink.
+Result run(const std::filesystem::path& config_dir, const char* config) {
+    std::ofstream(config_dir / "config.json") << config;
+    auto a_param = make_param("add 1");
+    auto b_param = make_param("add 10");
+    auto c_param = make_param("add 100");
+    Add  a(&a_param, 1), b(&b_param, 10), c(&c_param, 100);
+    const std::vector<std::pair<std::vector<SoundProcessor*>, f32>> chains = {{{&a, &b}, 11}, {{&c, &a, &b}, 111}, {{&b}, 10}, {{&b, &c}, 110}};
+
+    SafeVar<Pipeline> pipeline;
+    std::atomic<int>  delivered = 0;
+    std::atomic<int>  mixed     = 0;
+    {
+        std::lock_guard<std::mutex> lock(pipeline.lock);
+        pipeline->set_processors(chains[0].first);
+        pipeline->load();
+        pipeline->set_sink([&](PCMPacketUnit&& packet, u64) {
+            const auto value = reinterpret_cast<f32*>(packet.pcm.data())[0];
+            if(std::none_of(chains.begin(), chains.end(), [&](auto& chain) { return chain.second == value; })) mixed++;
+            delivered++;
+        });
+        pipeline->start(false);
+    }
+
+    Result            result;
+    std::atomic<bool> done = false;
+    std::thread       swapper([&] {
+        for(size_t i = 1; !done; ++i) {
+            std::lock_guard<std::mutex> lock(pipeline.lock);
+            pipeline->set_processors(chains[i % chains.size()].first);
+            result.swaps++;
+        }
+    });
+    for(int i = 0; i < packets; ++i) {
+        PCMPacketUnit packet;
+        packet.format                = PCMFormat{native_f32, channels, 48000};
+        packet.original_frame_pos[0] = i * frames;
+        packet.original_frame_pos[1] = (i + 1) * frames - 1;
+        packet.pcm.resize(frames * channels * sizeof(f32));
+        std::fill(packet.pcm.begin(), packet.pcm.end(), 0);
+        auto begin = std::chrono::steady_clock::now();
+        pipeline->process(std::move(packet), 1);
+        auto end      = std::chrono::steady_clock::now();
+        result.max_us = std::max(result.max_us, std::chrono::duration<f64, std::micro>(end - begin).count());
+    }
+    while(delivered != packets) std::this_thread::yield();
+    done = true;
+    swapper.join();
+    {
+        std::lock_guard<std::mutex> lock(pipeline.lock);
+        result.threads = pipeline->get_statistics().size();
+        pipeline->stop();
+    }
+    result.overlaps = a.overlaps + b.overlaps + c.overlaps;
+    result.mixed    = mixed;
+    return result;
+}
+} // namespace
+
+// Swaps the DSP chain while packets flow, in the synchronous mode and with DSP threads.
+// Fails if a processor is called on two threads at once, if a packet runs through stages of two chains,
+// or if a freed chain is used, which crashes on the poisoned memory.
+int main() {
+    std::signal(SIGSEGV, [](int) {
+        constexpr char message[] = "crashed. a freed chain was used.\n";
+        write(STDOUT_FILENO, message, sizeof(message) - 1);
+        _exit(1);
+    });
+    // An own configuration directory, to set the DSP threads.
+    const auto config_dir = std::filesystem::temp_directory_path() / "boxten_chainswap_benchmark";
+    std::filesystem::create_directories(config_dir);
+    if(!config::set_config_dir(config_dir)) {
+        std::printf("failed to set configuration directory: %s\n", config_dir.c_str());
+        return 1;
+    }
+    start_master_thread();
+    int failed = 0;
+    std::printf("%-60s %7s %8s %14s %9s %6s\n", "configuration", "threads", "swaps", "max process us", "overlaps", "mixed");
+    for(auto config : {R"({"dsp_budget": 0})",
+                       R"({"dsp_budget": 0, "dsp_threads": 2})",
+                       R"({"dsp_budget": 0, "dsp_threads": 3})",
+                       R"({"dsp_budget": 0, "dsp_threads": 2, "dsp_queue_packets": 1})"}) {
+        const auto result = run(config_dir, config);
+        std::printf("%-60s %7zu %8d %14.1f %9d %6d\n", config, result.threads, result.swaps, result.max_us, result.overlaps, result.mixed);
+        if(result.overlaps != 0 || result.mixed != 0) failed = 1;
+    }
+    finish_master_thread().join();
+    return failed;
+}
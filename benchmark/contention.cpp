@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include <configuration.hpp>
+#include <eventhook_internal.hpp>
+#include <module_forward.hpp>
+#include <playback.hpp>
+#include <playback_internal.hpp>
+#include <playlist.hpp>
+#include <plugin.hpp>
+#include <worker_internal.hpp>
+
+namespace {
+using namespace boxten;
+
+constexpr u32  channels      = 2;
+constexpr u32  sampling_rate = 44100;
+constexpr auto decode_time   = std::chrono::milliseconds(8);  // per PCMPACKET_PERIOD frames. about 70% of realtime.
+constexpr auto probe_time    = std::chrono::milliseconds(50); // the first calc_total_frames() of each file.
+constexpr int  samples       = 200;
+
+// An input which takes most of realtime to decode, so that the fill thread is decoding at almost any moment.
+class SlowInput : public StreamInput {
+  public:
+    std::atomic<u64> decodes = 0;
+
+    PCMPacketUnit read_frames(AudioFile&, u64 from, n_frames frames) override {
+        std::this_thread::sleep_for(decode_time * frames / PCMPACKET_PERIOD);
+        PCMPacketUnit packet;
+        packet.format                = PCMFormat{SampleType::s16_le, channels, sampling_rate};
+        packet.original_frame_pos[0] = from;
+        packet.original_frame_pos[1] = from + frames - 1;
+        packet.pcm.resize(frames * channels * sizeof(i16));
+        decodes++;
+        return packet;
+    }
+    n_frames calc_total_frames(AudioFile&) override {
+        std::this_thread::sleep_for(probe_time);
+        return sampling_rate * 600;
+    }
+    AudioTag read_tags(AudioFile&) override {
+        return {};
+    }
+    SlowInput(void* param) : StreamInput(param) {}
+};
+// Consumes the buffer in realtime, as a sound card does.
+class NullOutput : public StreamOutput {
+  private:
+    std::atomic<bool> running = false;
+    std::atomic<bool> paused  = false;
+    std::thread       thread;
+
+    void consume() {
+        const PCMFormat format = {SampleType::s16_le, channels, sampling_rate};
+        std::vector<u8> pcm(PCMPACKET_PERIOD * channels * sizeof(i16));
+        auto            next = std::chrono::steady_clock::now();
+        while(running) {
+            next += std::chrono::microseconds(1000000 * PCMPACKET_PERIOD / sampling_rate);
+            std::this_thread::sleep_until(next);
+            if(!paused) render_buffer_pcm(pcm.data(), PCMPACKET_PERIOD, format);
+        }
+    }
+
+  public:
+    void start_playback() override {
+        if(running) return;
+        running = true;
+        paused  = false;
+        thread  = std::thread([this] { consume(); });
+    }
+    void stop_playback() override {
+        running = false;
+        if(thread.joinable()) thread.join();
+    }
+    void pause_playback() override {
+        paused = true;
+    }
+    void resume_playback() override {
+        paused = false;
+    }
+    NullOutput(void* param) : StreamOutput(param) {}
+    ~NullOutput() {
+        stop_playback();
+    }
+};
+
+ComponentConstructionParam make_param(const char* name, COMPONENT_TYPE type) {
+    return ComponentConstructionParam("benchmark", ComponentInfo(name, type, nullptr, nullptr), [] {});
+}
+struct Latency {
+    const char*      name;
+    std::vector<f64> us;
+};
+template <typename Body>
+Latency measure(const char* name, Body body) {
+    Latency result{name, {}};
+    for(int i = 0; i < samples; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body(i);
+        auto end = std::chrono::steady_clock::now();
+        result.us.emplace_back(std::chrono::duration<f64, std::micro>(end - start).count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1)); // let the fill thread get back to decoding.
+    }
+    std::sort(result.us.begin(), result.us.end());
+    return result;
+}
+} // namespace
+
+// Measures how long the control paths take while the fill thread decodes from a slow StreamInput.
+// None of them should wait for a decode. Fails if the median latency of any of them reaches the time of one decode,
+// or if they do not finish in time.
+int main() {
+    auto       input_param  = make_param("slow input", COMPONENT_TYPE::STREAM_INPUT);
+    auto       output_param = make_param("null output", COMPONENT_TYPE::STREAM_OUTPUT);
+    SlowInput  input(&input_param);
+    NullOutput output(&output_param);
+    Playlist   playlist;
+
+    // An empty configuration directory, so that the defaults are used.
+    const auto config_dir = std::filesystem::temp_directory_path() / "boxten_contention_benchmark";
+    std::filesystem::create_directories(config_dir);
+    if(!config::set_config_dir(config_dir)) {
+        std::printf("failed to set configuration directory: %s\n", config_dir.c_str());
+        return 1;
+    }
+    start_master_thread();
+    start_playback_thread();
+    start_hook_invoker();
+    set_stream_input(&input);
+    set_stream_output(&output);
+    {
+        std::lock_guard<std::mutex> lock(playlist.mutex());
+        for(auto path : {"0.wav", "1.wav", "2.wav"}) playlist.add(path);
+    }
+    playlist.activate();
+
+    std::atomic<bool> done = false;
+    std::thread       watchdog([&] {
+        for(int i = 0; i < 600 && !done; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if(done) return;
+        std::printf("timed out. the control paths are deadlocked.\n");
+        std::_Exit(1);
+    });
+    start_playback(true);
+    while(input.decodes == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1)); // the playing song is probed.
+
+    std::vector<Latency> results;
+    const u64            decodes = input.decodes;
+    results.emplace_back(measure("song length", [](int) { get_playing_song_length(); }));
+    results.emplace_back(measure("seek", [](int i) { seek_rate_abs(0.5 * (i % 2), true); }));
+    results.emplace_back(measure("insert", [&](int) {
+        std::lock_guard<std::mutex> lock(playlist.mutex());
+        playlist.insert("extra.wav", playlist.end());
+    }));
+    results.emplace_back(measure("erase", [&](int) {
+        std::lock_guard<std::mutex> lock(playlist.mutex());
+        playlist.erase(playlist.end() - 1);
+    }));
+    const u64 decoded = input.decodes - decodes;
+    stop_playback(true);
+    done = true;
+    watchdog.join();
+    finish_hook_invoker();
+    finish_playback_thread();
+    finish_master_thread().join();
+
+    const f64 decode_us = std::chrono::duration<f64, std::micro>(decode_time).count();
+    bool      failed    = false;
+    std::printf("%-12s %10s %10s %10s %10s\n", "operation", "p50 us", "p90 us", "p99 us", "max us");
+    for(auto& r : results) {
+        auto at = [&](f64 p) { return r.us[static_cast<size_t>(p * (r.us.size() - 1))]; };
+        std::printf("%-12s %10.1f %10.1f %10.1f %10.1f\n", r.name, at(0.5), at(0.9), at(0.99), r.us.back());
+        failed |= at(0.5) >= decode_us;
+    }
+    std::printf("%lu packets decoded meanwhile, %.0f us each.\n", static_cast<unsigned long>(decoded), decode_us);
+    if(decoded == 0) {
+        std::printf("the fill thread did not decode.\n");
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <resampler.hpp>
+
+#include "bench.hpp"
+
+namespace {
+using namespace boxten;
+
+constexpr u32      channels = 2;
+constexpr n_frames packet   = PCMPACKET_PERIOD;
+constexpr n_frames frames   = 48000; // of input per measurement.
+
+struct Case {
+    u32 input_rate;
+    u32 output_rate;
+};
+constexpr Case cases[] = {{44100, 48000}, {48000, 44100}, {44100, 96000}, {44100, 192000}, {96000, 48000}};
+constexpr std::pair<ResamplerQuality, const char*> qualities[] = {
+    {ResamplerQuality::FAST, "fast"},
+    {ResamplerQuality::MEDIUM, "medium"},
+    {ResamplerQuality::BEST, "best"},
+};
+
+// Converts 'input' packet by packet, with the flush at the end. Returns the number of output frames.
+n_frames convert(Resampler& resampler, const std::vector<f32>& input, std::vector<f32>& output) {
+    n_frames written = 0;
+    for(n_frames done = 0; done < frames; done += packet) {
+        auto count = std::min(packet, frames - done);
+        written += resampler.process(input.data() + done * channels, count, output.data() + written * channels, done + count == frames);
+    }
+    return written;
+}
+} // namespace
+
+// Reports the speed of Resampler in multiples of realtime, for each preset and some rate pairs.
+// Fails if the output of a whole stream does not have the length the rates give.
+int main() {
+    std::vector<f32> input(frames * channels);
+    for(n_frames i = 0; i < frames; ++i) {
+        for(u32 c = 0; c < channels; ++c) {
+            input[i * channels + c] = 0.5 * std::sin(2 * M_PI * 1000 * i / 44100.0 + c);
+        }
+    }
+    int result = 0;
+    std::printf("%-16s %10s %10s %10s\n", "x realtime", qualities[0].second, qualities[1].second, qualities[2].second);
+    for(auto& c : cases) {
+        std::printf("%6u -> %6u ", c.input_rate, c.output_rate);
+        for(auto& [quality, name] : qualities) {
+            Resampler resampler;
+            resampler.configure(c.input_rate, c.output_rate, channels, quality);
+            std::vector<f32> output(resampler.max_output_frames(frames, true) * channels);
+            n_frames         written = 0;
+            auto             run     = [&] {
+                written = convert(resampler, input, output);
+                bench::keep(output);
+            };
+            auto ns = bench::measure(run, 10);
+            std::printf(" %10.0f", 1e9 * frames / c.input_rate / ns);
+            const auto expected = (static_cast<u64>(frames) * c.output_rate + c.input_rate - 1) / c.input_rate;
+            if(written != expected) {
+                std::printf("\n%s: %lu frames written, %lu expected.\n", name, static_cast<unsigned long>(written), static_cast<unsigned long>(expected));
+                result = 1;
+            }
+        }
+        std::printf("\n");
+    }
+    return result;
+}
@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <sampleconv.hpp>
+
+#include "bench.hpp"
+
+namespace {
+using boxten::SampleType;
+
+constexpr size_t samples = 4096 * 2; // 4096 stereo frames.
+
+struct Case {
+    const char* name;
+    SampleType  source;
+    SampleType  destination;
+};
+constexpr Case cases[] = {
+    {"s16 -> f32", SampleType::s16_le, SampleType::f32_le},
+    {"f32 -> s16", SampleType::f32_le, SampleType::s16_le},
+    {"s24 -> f32", SampleType::s24_le, SampleType::f32_le},
+    {"f32 -> s24", SampleType::f32_le, SampleType::s24_le},
+    {"s32 -> f32", SampleType::s32_le, SampleType::f32_le},
+    {"f32 -> s32", SampleType::f32_le, SampleType::s32_le},
+    {"s16 -> s32", SampleType::s16_le, SampleType::s32_le},
+    {"s24 -> s16", SampleType::s24_le, SampleType::s16_le},
+};
+
+std::vector<u8> make_source(SampleType type) {
+    auto            width = boxten::get_sample_bytewidth(type);
+    std::vector<u8> result(samples * width);
+    auto&           engine = bench::random_engine();
+    if(type == SampleType::f32_le) {
+        // a little out of range, so that clipping is measured too.
+        std::uniform_real_distribution<f32> distribution(-1.1, 1.1);
+        for(size_t i = 0; i < samples; ++i) {
+            auto v = distribution(engine);
+            std::memcpy(result.data() + i * 4, &v, 4);
+        }
+    } else {
+        std::uniform_int_distribution<int> distribution(0, 255);
+        for(auto& b : result) b = distribution(engine);
+    }
+    return result;
+}
+} // namespace
+
+// Compares convert_samples() with the scalar convert_samples_reference(). Fails if their results differ.
+int main() {
+    std::printf("backend: %s, %zu samples per call\n", boxten::get_sample_conversion_backend(), samples);
+    std::printf("%-12s %12s %12s %8s\n", "", "ns/sample", "reference", "speedup");
+    int result = 0;
+    for(auto& c : cases) {
+        auto            source = make_source(c.source);
+        std::vector<u8> vector(samples * boxten::get_sample_bytewidth(c.destination));
+        std::vector<u8> reference(vector.size());
+        auto            fast = bench::measure([&] {
+            boxten::convert_samples(source.data(), c.source, vector.data(), c.destination, samples);
+            bench::keep(vector);
+        });
+        auto            slow = bench::measure([&] {
+            boxten::convert_samples_reference(source.data(), c.source, reference.data(), c.destination, samples);
+            bench::keep(reference);
+        });
+        std::printf("%-12s %12.3f %12.3f %7.1fx\n", c.name, fast / samples, slow / samples, slow / fast);
+        if(vector != reference) {
+            std::printf("%s: result differs from the reference.\n", c.name);
+            result = 1;
+        }
+    }
+    return result;
+}
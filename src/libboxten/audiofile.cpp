@@ -29,18 +29,43 @@ void* AudioFile::get_private_data() {
     return input_module_private_data;
 }
 n_frames AudioFile::get_total_frames() {
-    if(total_frames == 0) {
-        total_frames = boxten::get_total_frames(this);
+    if(!total_frames_updated.load(std::memory_order_acquire)) {
+        std::lock_guard<std::recursive_mutex> lock(get_input_lock());
+        if(!total_frames_updated.load(std::memory_order_relaxed)) {
+            total_frames = boxten::get_total_frames(this);
+            total_frames_updated.store(true, std::memory_order_release);
+        }
     }
     return total_frames;
 }
 AudioTag AudioFile::get_tags() {
-    if(!tags_updated) {
-        tags         = boxten::get_tags(this);
-        tags_updated = true;
+    if(!tags_updated.load(std::memory_order_acquire)) {
+        std::lock_guard<std::recursive_mutex> lock(get_input_lock());
+        if(!tags_updated.load(std::memory_order_relaxed)) {
+            tags = boxten::get_tags(this);
+            tags_updated.store(true, std::memory_order_release);
+        }
     }
     return tags;
 }
+GaplessInfo AudioFile::get_gapless_info() {
+    if(!gapless_info_updated.load(std::memory_order_acquire)) {
+        std::lock_guard<std::recursive_mutex> lock(get_input_lock());
+        if(!gapless_info_updated.load(std::memory_order_relaxed)) {
+            gapless_info = boxten::get_gapless_info(this);
+            gapless_info_updated.store(true, std::memory_order_release);
+        }
+    }
+    return gapless_info;
+}
+n_frames AudioFile::get_playable_frames() {
+    auto gapless = get_gapless_info();
+    auto total   = get_total_frames();
+    return total > gapless.delay + gapless.padding ? total - gapless.delay - gapless.padding : total;
+}
+bool AudioFile::is_probed() {
+    return total_frames_updated.load(std::memory_order_acquire) && gapless_info_updated.load(std::memory_order_acquire);
+}
 bool AudioFile::cleanup_private_data(StreamInput* stream_input) {
     if(input_module_private_data_owner == stream_input) {
         free_input_module_private_data();
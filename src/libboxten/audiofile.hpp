@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <functional>
@@ -16,15 +17,20 @@ class AudioFile {
     const std::filesystem::path path;
     std::ifstream               handle;
 
-    n_frames                   total_frames = 0;
+    // Metadata is probed once under the input lock and published by the flags, so that later reads take no lock.
+    std::atomic<bool> total_frames_updated = false;
+    n_frames          total_frames         = 0;
 
     StreamInput*               input_module_private_data_owner = nullptr;
     void*                      input_module_private_data = nullptr;
     std::function<void(void*)> input_module_private_data_deleter;
     void                       free_input_module_private_data();
 
-    bool     tags_updated = false;
-    AudioTag tags;
+    std::atomic<bool> tags_updated = false;
+    AudioTag          tags;
+
+    std::atomic<bool> gapless_info_updated = false;
+    GaplessInfo       gapless_info;
 
   public:
     std::ifstream&        get_handle();
@@ -32,8 +38,11 @@ class AudioFile {
     void                  set_private_data(void* data, StreamInput* owner, std::function<void(void*)> deleter);
     void*                 get_private_data();
     bool                  cleanup_private_data(StreamInput* stream_input);
-    n_frames get_total_frames();
-    AudioTag get_tags();
+    n_frames    get_total_frames();
+    AudioTag    get_tags();
+    GaplessInfo get_gapless_info();
+    n_frames    get_playable_frames(); // total frames without encoder delay and padding.
+    bool        is_probed();           // true if get_playable_frames() returns without calling the input module.
 
     AudioFile(std::filesystem::path path) : path(path) {}
     ~AudioFile();
@@ -1,105 +1,245 @@
+#include <algorithm>
+
 #include "buffer.hpp"
 #include "type.hpp"
 
 
 namespace boxten{
-constexpr u64 buffer_limit = PCMPACKET_PERIOD * 32; // frames
-constexpr u64 unfreeze_threshold = PCMPACKET_PERIOD * 16;
+constexpr u64 default_buffer_limit       = PCMPACKET_PERIOD * 32; // frames
+constexpr u64 default_unfreeze_threshold = PCMPACKET_PERIOD * 16;
 
 void Buffer::notify_need_fill_buffer(){
+    u64 not_requested = 0;
+    refill_requested_ns.compare_exchange_strong(not_requested, steady_time_ns(), std::memory_order_relaxed);
     std::lock_guard<std::mutex> lock(need_fill_buffer.lock);
     need_fill_buffer = true;
     continue_fill_buffer.notify_one();
 }
 void Buffer::clear(){
     {
-        std::lock_guard<std::mutex> lock(data.lock);
-        data->clear();
+        std::lock_guard<std::mutex> lock(consumer_lock);
+        while(auto slot = data.front()) {
+            filled -= slot->frames - consumed;
+            consumed = 0;
+            PCMStorage().swap(slot->unit.pcm); // return the block to the pool.
+            data.pop();
+        }
     }
     notify_need_fill_buffer();
 }
 n_frames Buffer::filled_frame() {
-    n_frames filled = 0;
-    std::lock_guard<std::mutex> lock(data.lock);
-    for(auto& b : static_cast<PCMPacket&>(data)) {
-        filled += b.get_frames();
-    }
-    return filled;
+    return filled.load(std::memory_order_acquire);
 }
 n_frames Buffer::free_frame() {
+    if(data.full()) return 0;
     auto filled = filled_frame();
-    return buffer_limit < filled ? 0 : buffer_limit - filled;
+    auto limit  = buffer_limit.load(std::memory_order_relaxed);
+    return limit < filled ? 0 : limit - filled;
 }
-void Buffer::append(PCMPacketUnit& packet) {
-    std::lock_guard<std::mutex> lock(data.lock);
-    data->emplace_back();
-    {
-        auto& buff  = data->back();
-        buff.format = packet.format;
-        buff.original_frame_pos[0] = packet.original_frame_pos[0];
-        buff.original_frame_pos[1] = packet.original_frame_pos[1];
-        std::copy(packet.pcm.begin(), packet.pcm.end(), std::back_inserter(buff.pcm));
+bool Buffer::needs_refill() {
+    return filled_frame() < high_watermark.load(std::memory_order_relaxed) && free_frame() >= PCMPACKET_PERIOD && !data.full();
+}
+void Buffer::notify_if_below_low_watermark() {
+    if(filled_frame() < low_watermark.load(std::memory_order_relaxed)) notify_need_fill_buffer();
+}
+n_frames Buffer::check_underrun(n_frames frame) {
+    auto filled = filled_frame();
+    if(frame > filled) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        if(buffer_underrun_handler) buffer_underrun_handler();
+        frame = filled;
     }
+    return frame;
+}
+void Buffer::release_front(Slot& slot, n_frames frames) {
+    consumed += frames;
+    if(consumed == slot.frames) {
+        consumed = 0;
+        PCMStorage().swap(slot.unit.pcm);
+        data.pop();
+    }
+    filled.fetch_sub(frames, std::memory_order_release);
+}
+void Buffer::record_fill_level() {
+    auto   limit = buffer_limit.load(std::memory_order_relaxed);
+    size_t bin   = limit == 0 ? 0 : filled_frame() * buffer_histogram_bins / limit;
+    if(bin >= buffer_histogram_bins) bin = buffer_histogram_bins - 1;
+    fill_histogram[bin].fetch_add(1, std::memory_order_relaxed);
 }
-void Buffer::append(PCMPacket& packet) {
+void Buffer::record_played(n_frames frames, u32 sampling_rate) {
+    if(sampling_rate == 0) return;
+    played_ns.fetch_add(frames * 1000000000 / sampling_rate, std::memory_order_relaxed);
+}
+void Buffer::append(PCMPacketUnit&& packet) {
+    auto frames = packet.get_frames();
+    if(frames == 0) return;
+    Slot slot;
+    slot.frames = frames;
+    slot.unit   = std::move(packet);
+    if(data.push(std::move(slot))) {
+        filled.fetch_add(frames, std::memory_order_release);
+    }
+}
+void Buffer::append(PCMPacket&& packet) {
     for(auto& unit : packet){
-        append(unit);
+        append(std::move(unit));
     }
 }
 PCMPacket Buffer::cut(n_frames frame) {
-    {
-        auto filled = filled_frame();
-        if(frame > filled) {
-            if(buffer_underrun_handler) buffer_underrun_handler();
-            frame = filled;
-        }
-    }
+    record_fill_level();
+    frame = check_underrun(frame);
 
     auto to_cut = frame;
     PCMPacket result;
     {
-        std::lock_guard<std::mutex> lock(data.lock);
-        for(auto i = data->begin(); i != data->end();) {
+        std::lock_guard<std::mutex> lock(consumer_lock);
+        while(to_cut > 0) {
+            auto slot = data.front();
+            if(slot == nullptr) break;
+
+            auto&    unit    = slot->unit;
+            n_frames in_slot = slot->frames - consumed;
             result.emplace_back();
             auto& new_packet  = result.back();
-            new_packet.format = (*i).format;
-
-            n_frames in_vector = (*i).get_frames();
-            if(in_vector > to_cut) {
-                u64 limit = (*i).format.channels * to_cut * get_sample_bytewidth((*i).format.sample_type);
-                std::copy((*i).pcm.begin(), (*i).pcm.begin() + limit, std::back_inserter(new_packet.pcm));
-                (*i).pcm.erase((*i).pcm.begin(), (*i).pcm.begin() + limit);
-                new_packet.original_frame_pos[0] = (*i).original_frame_pos[0];
-                (*i).original_frame_pos[0] += to_cut;
-                new_packet.original_frame_pos[1] = (*i).original_frame_pos[0];
-                to_cut = 0;
-                i++;
+            new_packet.format = unit.format;
+            if(consumed == 0 && in_slot <= to_cut) {
+                // whole packet. hand over its storage.
+                new_packet.pcm                   = std::move(unit.pcm);
+                new_packet.original_frame_pos[0] = unit.original_frame_pos[0];
+                new_packet.original_frame_pos[1] = unit.original_frame_pos[1];
             } else {
-                new_packet.pcm = std::move((*i).pcm);
-                new_packet.original_frame_pos[0] = (*i).original_frame_pos[0];
-                new_packet.original_frame_pos[1] = (*i).original_frame_pos[1];
-                i                                = data->erase(i);
-                to_cut -= in_vector;
+                n_frames part        = in_slot > to_cut ? to_cut : in_slot;
+                u64      frame_bytes = unit.format.channels * get_sample_bytewidth(unit.format.sample_type);
+                auto     begin       = unit.pcm.begin() + consumed * frame_bytes;
+                new_packet.pcm.assign(begin, begin + part * frame_bytes);
+                get_positions(*slot, consumed, consumed + part, new_packet.original_frame_pos);
+                in_slot = part;
+                copied_frames.fetch_add(part, std::memory_order_relaxed);
             }
-            if(to_cut == 0) break;
+            to_cut -= in_slot;
+            record_played(in_slot, unit.format.sampling_rate);
+            release_front(*slot, in_slot);
         }
     }
-    notify_need_fill_buffer();
+    output_frames.fetch_add(frame - to_cut, std::memory_order_relaxed);
+    notify_if_below_low_watermark();
     return result;
 }
 PCMFormat Buffer::get_next_format() {
-    std::lock_guard<std::mutex> lock(data.lock);
-    if(data->empty()){
-        PCMFormat result;
-        result.sample_type = SampleType::unknown;
-        return result;
+    std::lock_guard<std::mutex> lock(consumer_lock);
+    if(auto slot = data.front(); slot != nullptr) {
+        return slot->unit.format;
     }
-    return data->operator[](0).format;
+    PCMFormat result;
+    result.sample_type = SampleType::unknown;
+    return result;
 }
 bool Buffer::has_enough_packets(){
-    return filled_frame() >= unfreeze_threshold;
+    return filled_frame() >= unfreeze_threshold.load(std::memory_order_relaxed);
 }
 void Buffer::set_buffer_underrun_handler(std::function<void(void)> handler){
     buffer_underrun_handler = handler;
 }
+void Buffer::set_limits(n_frames limit, n_frames unfreeze, n_frames low, n_frames high) {
+    if(limit < PCMPACKET_PERIOD * 2) limit = PCMPACKET_PERIOD * 2;
+    if(unfreeze > limit) unfreeze = limit;
+    if(high > limit) high = limit;
+    if(high < unfreeze) high = unfreeze;
+    if(low >= high) low = high - PCMPACKET_PERIOD;
+    if(low < PCMPACKET_PERIOD) low = PCMPACKET_PERIOD;
+    buffer_limit       = limit;
+    unfreeze_threshold = unfreeze;
+    low_watermark      = low;
+    high_watermark     = high;
+}
+void Buffer::resize(n_frames max_limit) {
+    // Packets are PCMPACKET_PERIOD frames long except at the end of songs and after downsampling, so leave room for short ones.
+    data.resize((max_limit + PCMPACKET_PERIOD - 1) / PCMPACKET_PERIOD * 4);
+    filled   = 0;
+    consumed = 0;
+}
+void Buffer::record_wakeup() {
+    wakeups.fetch_add(1, std::memory_order_relaxed);
+}
+void Buffer::record_burst(n_frames frames) {
+    if(frames == 0) return;
+    bursts.fetch_add(1, std::memory_order_relaxed);
+    last_burst_frames = frames;
+    total_burst_frames.fetch_add(frames, std::memory_order_relaxed);
+    if(frames > max_burst_frames) max_burst_frames = frames;
+}
+void Buffer::record_fill_cpu_time(u64 ns) {
+    fill_cpu_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+void Buffer::record_refill_done() {
+    if(auto requested = refill_requested_ns.exchange(0, std::memory_order_relaxed); requested != 0) {
+        refill_latency.record(steady_time_ns() - requested);
+    }
+}
+void Buffer::record_freeze(u64 ns) {
+    freeze.record(ns);
+    const auto count = freeze_history_count.load(std::memory_order_relaxed);
+    freeze_history[count % freeze_history_length].store(ns, std::memory_order_relaxed);
+    freeze_history_count.store(count + 1, std::memory_order_release);
+}
+void Buffer::record_decode_time(u64 ns) {
+    decode_time.record(ns);
+}
+void Buffer::reset_statistics() {
+    wakeups            = 0;
+    bursts             = 0;
+    last_burst_frames  = 0;
+    max_burst_frames   = 0;
+    total_burst_frames = 0;
+    output_frames      = 0;
+    copied_frames      = 0;
+    played_ns          = 0;
+    fill_cpu_ns        = 0;
+    for(auto& b : fill_histogram) b = 0;
+    underruns = 0;
+    freeze.reset();
+    for(auto& f : freeze_history) f = 0;
+    freeze_history_count = 0;
+    refill_latency.reset();
+    decode_time.reset();
+}
+BufferStatistics Buffer::get_statistics() {
+    BufferStatistics result;
+    result.wakeups            = wakeups;
+    result.bursts             = bursts;
+    result.last_burst_frames  = last_burst_frames;
+    result.max_burst_frames   = max_burst_frames;
+    result.total_burst_frames = total_burst_frames;
+    result.low_watermark      = low_watermark;
+    result.high_watermark     = high_watermark;
+    result.buffer_limit       = buffer_limit;
+    result.unfreeze_threshold = unfreeze_threshold;
+    result.played_ns          = played_ns;
+    result.fill_cpu_ns        = fill_cpu_ns;
+
+    for(size_t i = 0; i < buffer_histogram_bins; ++i) result.fill_histogram[i] = fill_histogram[i];
+    result.underruns      = underruns;
+    result.freeze         = freeze.get();
+    const auto freezes    = freeze_history_count.load(std::memory_order_acquire);
+    result.recent_freezes = std::min<u64>(freezes, freeze_history_length);
+    for(size_t i = 0; i < result.recent_freezes; ++i) {
+        result.recent_freezes_ns[i] = freeze_history[(freezes - result.recent_freezes + i) % freeze_history_length];
+    }
+    result.refill_latency = refill_latency.get();
+    result.decode_time    = decode_time.get();
+
+    const f64 played_minutes         = result.played_ns / 60e9;
+    result.wakeups_per_minute        = played_minutes > 0 ? result.wakeups / played_minutes : 0;
+    result.fill_cpu_seconds_per_hour = played_minutes > 0 ? result.fill_cpu_ns / 1e9 / (played_minutes / 60) : 0;
+    result.output_frames      = output_frames;
+    result.copied_frames      = copied_frames;
+    return result;
+}
+size_t Buffer::slot_capacity() {
+    return data.capacity();
+}
+Buffer::Buffer() {
+    resize(default_buffer_limit);
+    set_limits(default_buffer_limit, default_unfreeze_threshold, default_buffer_limit / 2, default_buffer_limit);
+}
 }
@@ -1,19 +1,78 @@
 /* This is an internal header, which will not be installed. */
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <stdio.h>
 #include <functional>
 
+#include "counter.hpp"
+#include "ringbuffer.hpp"
+#include "statistics.hpp"
 #include "type.hpp"
 
 namespace boxten {
+// Non-owning reference to frames which are still stored in Buffer.
+struct PCMView {
+    PCMFormat format;
+    u64       original_frame_pos[2];
+    const u8* pcm;
+    n_frames  frames;
+};
+
+// Single-producer(fill thread)/single-consumer(StreamOutput) PCM buffer.
+// The producer never takes a lock. Consumer side functions(cut(), clear(), get_next_format()) are
+// serialized by consumer_lock, which the producer never holds.
 class Buffer {
   private:
-    SafeVar<PCMPacket>        data;
+    struct Slot {
+        PCMPacketUnit unit;
+        n_frames      frames = 0;
+    };
+    SPSCRing<Slot>            data;
+    std::atomic<n_frames>     filled   = 0;
+    n_frames                  consumed = 0; // frames already cut from the front slot.
+    std::mutex                consumer_lock;
     std::function<void(void)> buffer_underrun_handler;
 
-    void notify_need_fill_buffer();
+    std::atomic<n_frames> buffer_limit;
+    std::atomic<n_frames> unfreeze_threshold;
+    // The fill thread is woken when filled frames fall below low_watermark, then refills up to high_watermark.
+    std::atomic<n_frames> low_watermark;
+    std::atomic<n_frames> high_watermark;
+
+    std::atomic<u64>      wakeups            = 0;
+    std::atomic<u64>      bursts             = 0;
+    std::atomic<n_frames> last_burst_frames  = 0;
+    std::atomic<n_frames> max_burst_frames   = 0;
+    std::atomic<n_frames> total_burst_frames = 0;
+    std::atomic<n_frames> output_frames      = 0;
+    std::atomic<n_frames> copied_frames      = 0;
+    std::atomic<u64>      played_ns          = 0; // duration of output_frames.
+    std::atomic<u64>      fill_cpu_ns        = 0; // cpu time consumed by the fill thread.
+    std::atomic<u64>      fill_histogram[buffer_histogram_bins] = {};
+    std::atomic<u64>      underruns                             = 0;
+    std::atomic<u64>      refill_requested_ns                   = 0; // 0 if no request is pending.
+    LatencyCounter        freeze;
+    std::atomic<u64>      freeze_history[freeze_history_length] = {}; // ring of durations. written by one thread at a time.
+    std::atomic<u64>      freeze_history_count                  = 0;
+    LatencyCounter        refill_latency;
+    LatencyCounter        decode_time;
+
+    // Original positions of frames [begin, end) of the slot. Resampled packets have more or fewer frames than positions.
+    static void get_positions(const Slot& slot, n_frames begin, n_frames end, u64 (&positions)[2]) {
+        const auto first = slot.unit.original_frame_pos[0];
+        const u64  count = slot.unit.original_frame_pos[1] - first + 1;
+        positions[0]     = first + count * begin / slot.frames;
+        positions[1]     = std::max(positions[0], first + count * end / slot.frames - 1);
+    }
+    void     notify_need_fill_buffer();
+    void     notify_if_below_low_watermark();
+    n_frames check_underrun(n_frames frame);
+    void     release_front(Slot& slot, n_frames frames); // consumer_lock must be locked.
+    void     record_played(n_frames frames, u32 sampling_rate);
+    void     record_fill_level();
 
   public:
     SafeVar<bool>           need_fill_buffer = true;
@@ -22,12 +81,63 @@ class Buffer {
     void clear();
     n_frames filled_frame();
     n_frames free_frame();
-    void append(PCMPacketUnit& packet);
-    void append(PCMPacket& packet);
+    bool     needs_refill(); // true until high watermark is reached.
+    void append(PCMPacketUnit&& packet);
+    void append(PCMPacket&& packet);
     PCMPacket cut(n_frames frame);
+
+    // Passes up to 'frame' frames to callback without copying them.
+    // callback(const PCMView&) returns how many frames of the view it used, and reading stops if it used less than given.
+    template <class Callback>
+    n_frames read(n_frames frame, Callback callback) {
+        record_fill_level();
+        frame = check_underrun(frame);
+
+        n_frames done = 0;
+        {
+            std::lock_guard<std::mutex> lock(consumer_lock);
+            while(done < frame) {
+                auto slot = data.front();
+                if(slot == nullptr) break;
+
+                auto&    unit        = slot->unit;
+                n_frames in_slot     = slot->frames - consumed;
+                n_frames part        = in_slot > frame - done ? frame - done : in_slot;
+                u64      frame_bytes = unit.format.channels * get_sample_bytewidth(unit.format.sample_type);
+                PCMView  view;
+                view.format                = unit.format;
+                get_positions(*slot, consumed, consumed + part, view.original_frame_pos);
+                view.pcm    = unit.pcm.data() + consumed * frame_bytes;
+                view.frames = part;
+
+                n_frames used = callback(static_cast<const PCMView&>(view));
+                record_played(used, unit.format.sampling_rate);
+                release_front(*slot, used);
+                done += used;
+                if(used < part) break;
+            }
+        }
+        output_frames.fetch_add(done, std::memory_order_relaxed);
+        notify_if_below_low_watermark();
+        return done;
+    }
     PCMFormat get_next_format();
     bool      has_enough_packets();
 
     void set_buffer_underrun_handler(std::function<void(void)> handler);
+    // Limits can be changed during playback, as long as they do not exceed the size given to resize().
+    void set_limits(n_frames limit, n_frames unfreeze, n_frames low, n_frames high);
+    void resize(n_frames max_limit); // buffer must be empty and unused.
+
+    void             record_wakeup();
+    void             record_burst(n_frames frames);
+    void             record_fill_cpu_time(u64 ns);
+    void             record_refill_done();
+    void             record_freeze(u64 ns);
+    void             record_decode_time(u64 ns);
+    void             reset_statistics();
+    BufferStatistics get_statistics();
+    size_t           slot_capacity();
+    Buffer();
 };
-} // namespace boxten
\ No newline at end of file
+} // namespace boxten
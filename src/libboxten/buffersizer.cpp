@@ -0,0 +1,127 @@
+#include <algorithm>
+
+#include "buffersizer.hpp"
+#include "configuration.hpp"
+#include "jsontest.hpp"
+
+namespace boxten {
+namespace {
+constexpr f64 grow_rate   = 1.5;
+constexpr f64 shrink_rate = 0.9;
+
+n_frames ms_to_frames(i64 ms, u32 rate) {
+    return ms <= 0 ? 0 : static_cast<n_frames>(ms) * rate / 1000;
+}
+void read_timing(const nlohmann::json& cfg, i64& value, const char* key) {
+    if(type_check(key, JSON_TYPE::NUMBER, cfg)) value = cfg[key].get<i64>();
+}
+// Overwrites members of timing which are written in cfg.
+template <class Timing>
+void overlay_timing(const nlohmann::json& cfg, u32 rate, Timing& timing) {
+    if(!cfg.is_object()) return;
+    read_timing(cfg, timing.length_ms, "length_ms");
+    read_timing(cfg, timing.unfreeze_ms, "unfreeze_ms");
+    read_timing(cfg, timing.low_watermark_ms, "low_watermark_ms");
+    read_timing(cfg, timing.high_watermark_ms, "high_watermark_ms");
+    read_timing(cfg, timing.max_length_ms, "max_length_ms");
+    read_timing(cfg, timing.shrink_interval_ms, "shrink_interval_ms");
+    if(cfg.contains("adaptive") && cfg["adaptive"].is_boolean()) timing.adaptive = cfg["adaptive"].get<bool>();
+    if(type_check("rates", JSON_TYPE::OBJECT, cfg)) {
+        auto key = std::to_string(rate);
+        if(cfg["rates"].contains(key)) overlay_timing(cfg["rates"][key], 0, timing);
+    }
+}
+} // namespace
+
+BufferSizer::Timing BufferSizer::get_timing(u32 rate) {
+    Timing result = deep ? deep_timing : Timing();
+    overlay_timing(config, rate, result);
+    if(config.is_object() && type_check("devices", JSON_TYPE::OBJECT, config) && config["devices"].contains(device)) {
+        overlay_timing(config["devices"][device], rate, result);
+    }
+    if(result.length_ms < 1) result.length_ms = 1;
+    if(result.max_length_ms < result.length_ms) result.max_length_ms = result.length_ms * 4;
+    return result;
+}
+void BufferSizer::apply(Buffer& buffer) {
+    auto scaled = [&](i64 ms) { return ms_to_frames(ms * scale, sampling_rate); };
+
+    n_frames length = scaled(timing.length_ms);
+    n_frames low    = length / 2;
+    n_frames high   = length;
+    if(timing.low_watermark_ms >= 0) {
+        low = scaled(timing.low_watermark_ms);
+    } else if(legacy_low >= 0) {
+        low = std::min<n_frames>(legacy_low * PCMPACKET_PERIOD, length);
+    }
+    if(timing.high_watermark_ms >= 0) {
+        high = scaled(timing.high_watermark_ms);
+    } else if(legacy_high >= 0) {
+        high = std::min<n_frames>(legacy_high * PCMPACKET_PERIOD, length);
+    }
+    buffer.set_limits(length, scaled(timing.unfreeze_ms), low, high);
+}
+void BufferSizer::load(const ComponentName& output) {
+    config      = nlohmann::json();
+    legacy_low  = -1;
+    legacy_high = -1;
+    if(nlohmann::json config_data; config::load_configuration(config_data) && config_data.is_object()) {
+        if(type_check("buffer", JSON_TYPE::OBJECT, config_data)) config = config_data["buffer"];
+        if(type_check("buffer_low_watermark", JSON_TYPE::NUMBER, config_data)) legacy_low = config_data["buffer_low_watermark"].get<i64>();
+        if(type_check("buffer_high_watermark", JSON_TYPE::NUMBER, config_data)) legacy_high = config_data["buffer_high_watermark"].get<i64>();
+    }
+    deep              = config.is_object() && config.value("mode", "") == "deep";
+    device            = output[0] + "/" + output[1];
+    sampling_rate     = 0;
+    scale             = 1.0;
+    underruns         = 0;
+    handled_underruns = 0;
+    last_change       = std::chrono::steady_clock::now();
+}
+n_frames BufferSizer::max_frames() {
+    std::vector<u32> rates = {44100, 48000, 88200, 96000, 176400, 192000};
+    auto             collect_rates = [&rates](const nlohmann::json& cfg) {
+        if(!cfg.is_object() || !type_check("rates", JSON_TYPE::OBJECT, cfg)) return;
+        for(auto& r : cfg["rates"].items()) {
+            rates.emplace_back(std::strtoul(r.key().data(), nullptr, 10));
+        }
+    };
+    collect_rates(config);
+    if(config.is_object() && type_check("devices", JSON_TYPE::OBJECT, config) && config["devices"].contains(device)) {
+        collect_rates(config["devices"][device]);
+    }
+    n_frames result = 0;
+    for(auto r : rates) {
+        auto t      = get_timing(r);
+        auto frames = ms_to_frames(t.adaptive ? t.max_length_ms : t.length_ms, r);
+        if(frames > result) result = frames;
+    }
+    return result;
+}
+void BufferSizer::report_underrun() {
+    underruns.fetch_add(1, std::memory_order_relaxed);
+}
+void BufferSizer::update(Buffer& buffer, u32 rate) {
+    bool changed = false;
+    if(rate != sampling_rate) {
+        sampling_rate = rate;
+        timing        = get_timing(rate);
+        changed       = true;
+    }
+    if(timing.adaptive) {
+        auto now       = std::chrono::steady_clock::now();
+        auto max_scale = static_cast<f64>(timing.max_length_ms) / timing.length_ms;
+        if(auto u = underruns.load(std::memory_order_relaxed); u != handled_underruns) {
+            handled_underruns = u;
+            scale             = scale * grow_rate > max_scale ? max_scale : scale * grow_rate;
+            last_change       = now;
+            changed           = true;
+        } else if(scale > 1.0 && now - last_change > std::chrono::milliseconds(timing.shrink_interval_ms)) {
+            scale       = scale * shrink_rate < 1.0 ? 1.0 : scale * shrink_rate;
+            last_change = now;
+            changed     = true;
+        }
+    }
+    if(changed) apply(buffer);
+}
+} // namespace boxten
@@ -0,0 +1,50 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <atomic>
+#include <chrono>
+
+#include "buffer.hpp"
+#include "json.hpp"
+#include "type.hpp"
+
+namespace boxten {
+// Decides Buffer limits from the "buffer" section of boxten configuration.
+// Lengths are written in milliseconds, and can be overridden per output device and per sampling rate.
+// "buffer_low_watermark" and "buffer_high_watermark" of older configurations, written in periods, are still read
+// when the section has no watermarks.
+class BufferSizer {
+  private:
+    struct Timing {
+        i64  length_ms          = 370;
+        i64  unfreeze_ms        = 185;
+        i64  low_watermark_ms   = -1; // negative means half of length.
+        i64  high_watermark_ms  = -1; // negative means length.
+        i64  max_length_ms      = -1; // upper limit of adaptive sizing. negative means 4 times length.
+        i64  shrink_interval_ms = 30000;
+        bool adaptive           = false;
+    };
+    // Deep mode holds minutes of audio and refills it in long bursts, to save wakeups and power.
+    static constexpr Timing deep_timing = {300000, 2000, 30000, -1, -1, 30000, false};
+    nlohmann::json config;
+    std::string    device;
+    bool           deep = false;
+    Timing         timing;
+    u32            sampling_rate = 0;
+    f64            scale         = 1.0;
+    i64            legacy_low    = -1; // "buffer_low_watermark" in periods. negative if not written.
+    i64            legacy_high   = -1;
+
+    std::atomic<u64>                      underruns         = 0; // reported by the output thread, handled by the fill thread.
+    u64                                   handled_underruns = 0;
+    std::chrono::steady_clock::time_point last_change;
+
+    Timing get_timing(u32 rate);
+    void   apply(Buffer& buffer);
+
+  public:
+    void     load(const ComponentName& output); // call this before the fill thread starts.
+    n_frames max_frames();                      // the largest limit load()ed configuration can request.
+    void     report_underrun();
+    void     update(Buffer& buffer, u32 rate); // call this from the fill thread.
+};
+} // namespace boxten
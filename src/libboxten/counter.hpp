@@ -0,0 +1,51 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <ctime>
+
+#include "statistics.hpp"
+#include "type.hpp"
+
+namespace boxten {
+inline u64 steady_time_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline u64 thread_cpu_time_ns() {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+// Accumulates durations. record() may be called from one thread while get() is called from others.
+class LatencyCounter {
+  private:
+    std::atomic<u64> count    = 0;
+    std::atomic<u64> total_ns = 0;
+    std::atomic<u64> max_ns   = 0;
+    std::atomic<u64> last_ns  = 0;
+
+  public:
+    void record(u64 ns) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        total_ns.fetch_add(ns, std::memory_order_relaxed);
+        last_ns.store(ns, std::memory_order_relaxed);
+        if(ns > max_ns.load(std::memory_order_relaxed)) max_ns.store(ns, std::memory_order_relaxed);
+    }
+    void reset() {
+        count    = 0;
+        total_ns = 0;
+        max_ns   = 0;
+        last_ns  = 0;
+    }
+    LatencyStatistics get() const {
+        LatencyStatistics result;
+        result.count      = count;
+        result.total_ns   = total_ns;
+        result.max_ns     = max_ns;
+        result.last_ns    = last_ns;
+        result.average_ns = result.count == 0 ? 0 : static_cast<f64>(result.total_ns) / result.count;
+        return result;
+    }
+};
+} // namespace boxten
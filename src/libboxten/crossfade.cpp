@@ -0,0 +1,221 @@
+#include <cmath>
+#include <cstring>
+#include <strings.h>
+
+#include "configuration.hpp"
+#include "crossfade.hpp"
+#include "jsontest.hpp"
+#include "playback_internal.hpp"
+#include "realtime.hpp"
+#include "sampleconv.hpp"
+
+namespace boxten {
+namespace {
+typedef f32 vf32 __attribute__((vector_size(32)));
+constexpr size_t lanes = sizeof(vf32) / sizeof(f32);
+
+// out = out * out_gain + in * in_gain, where gains move by *_step every frame.
+void mix_ramp(f32* out, const f32* in, n_frames frames, u32 channels, f32 out_gain, f32 out_step, f32 in_gain, f32 in_step) {
+    size_t       i       = 0;
+    const size_t samples = frames * channels;
+    if(lanes % channels == 0) {
+        // Each vector holds whole frames.
+        const size_t frames_per_vector = lanes / channels;
+        vf32         vout_gain, vin_gain;
+        for(size_t l = 0; l < lanes; ++l) {
+            vout_gain[l] = out_gain + static_cast<f32>(l / channels) * out_step;
+            vin_gain[l]  = in_gain + static_cast<f32>(l / channels) * in_step;
+        }
+        const f32 out_advance = out_step * frames_per_vector;
+        const f32 in_advance  = in_step * frames_per_vector;
+        for(; i + lanes <= samples; i += lanes) {
+            vf32 a, b;
+            std::memcpy(&a, out + i, sizeof(a));
+            std::memcpy(&b, in + i, sizeof(b));
+            a = a * vout_gain + b * vin_gain;
+            std::memcpy(out + i, &a, sizeof(a));
+            vout_gain += out_advance;
+            vin_gain += in_advance;
+        }
+    }
+    for(; i < samples; ++i) {
+        const f32 frame = static_cast<f32>(i / channels);
+        out[i]          = out[i] * (out_gain + frame * out_step) + in[i] * (in_gain + frame * in_step);
+    }
+}
+void get_gains(Crossfader::Curve curve, f64 progress, f32& out_gain, f32& in_gain) {
+    if(curve == Crossfader::Curve::LINEAR) {
+        out_gain = 1.0 - progress;
+        in_gain  = progress;
+    } else {
+        out_gain = std::cos(progress * M_PI / 2);
+        in_gain  = std::sin(progress * M_PI / 2);
+    }
+}
+const std::string* find_tag(const AudioTag& tags, const char* key) {
+    for(auto& t : tags) {
+        if(strcasecmp(t.first.data(), key) == 0) return &t.second;
+    }
+    return nullptr;
+}
+bool parse_curve(const std::string& name, Crossfader::Curve& curve) {
+    if(name == "equal_power") {
+        curve = Crossfader::Curve::EQUAL_POWER;
+    } else if(name == "linear") {
+        curve = Crossfader::Curve::LINEAR;
+    } else {
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+void Crossfader::plan(AudioFile& outgoing, AudioFile* incoming, u32 sampling_rate) {
+    reset();
+    this->outgoing = &outgoing;
+    this->incoming = incoming;
+    if(incoming == nullptr || sampling_rate == 0) return;
+
+    i64 fade_ms = ms;
+    fade_curve  = curve;
+    if(from_tags || !albums) {
+        auto tags = outgoing.get_tags();
+        if(from_tags) {
+            if(auto tag = find_tag(tags, "crossfade_ms"); tag != nullptr) fade_ms = std::strtoll(tag->data(), nullptr, 10);
+            if(auto tag = find_tag(tags, "crossfade_curve"); tag != nullptr) parse_curve(*tag, fade_curve);
+        }
+        if(!albums) {
+            auto next_tags = incoming->get_tags();
+            auto album     = find_tag(tags, "album");
+            auto next      = find_tag(next_tags, "album");
+            if(album != nullptr && next != nullptr && !album->empty() && *album == *next) fade_ms = 0;
+        }
+    }
+    if(fade_ms <= 0) return;
+    length = static_cast<n_frames>(fade_ms) * sampling_rate / 1000;
+    // The fade can not be longer than either song.
+    length = std::min({length, outgoing.get_playable_frames(), incoming->get_playable_frames()});
+    queue.reserve(length / PCMPACKET_PERIOD + 4);
+}
+bool Crossfader::decode_incoming(const PCMFormat& format) {
+    if(incoming_ended) return false;
+    auto frames = std::min(PCMPACKET_PERIOD, incoming->get_playable_frames() - incoming_frame);
+    if(frames == 0) {
+        incoming_ended = true;
+        return false;
+    }
+    auto packet = read_playable_frames(*incoming, incoming_frame, frames);
+    // Songs are mixed as they are. Crossfades between different rates or channels are not supported.
+    if(packet.format.channels != format.channels || packet.format.sampling_rate != format.sampling_rate ||
+       packet.format.get_sample_bytewidth() == 0 || packet.get_frames() == 0) {
+        incoming_ended = true;
+        if(queued_frames == 0) length = 0;
+        return false;
+    }
+    incoming_frame = packet.original_frame_pos[1] + 1;
+    queued_frames += packet.get_frames();
+    queue.emplace_back(std::move(packet));
+    return true;
+}
+void Crossfader::mix(PCMPacketUnit& packet, n_frames skip, n_frames fade_start) {
+    const auto channels = packet.format.channels;
+    const auto frames   = packet.get_frames();
+    const auto faded    = frames - skip;
+    const auto mixed    = std::min(faded, queued_frames);
+    if(mixed == 0) return;
+
+    // Frames before 'skip' are left as they are, so that they keep the precision f32 does not have.
+    auto tail = packet.pcm.data() + skip * channels * packet.format.get_sample_bytewidth();
+    outgoing_pcm.resize(faded * channels * sizeof(f32));
+    convert_samples(tail, packet.format.sample_type, outgoing_pcm.data(), native_f32, faded * channels);
+    incoming_pcm.resize(mixed * channels * sizeof(f32));
+    for(n_frames done = 0; done < mixed;) {
+        auto& head  = queue[queue_head];
+        auto  count = std::min(head.get_frames() - head_consumed, mixed - done);
+        auto  width = head.format.get_sample_bytewidth();
+        convert_samples(head.pcm.data() + head_consumed * channels * width, head.format.sample_type,
+                        incoming_pcm.data() + done * channels * sizeof(f32), native_f32, count * channels);
+        done += count;
+        head_consumed += count;
+        queued_frames -= count;
+        if(head_consumed == head.get_frames()) {
+            PCMStorage().swap(head.pcm); // returns the block to the pool now.
+            queue_head += 1;
+            head_consumed = 0;
+        }
+    }
+
+    f32 out_gain, in_gain, out_end, in_end;
+    get_gains(fade_curve, static_cast<f64>(packet.original_frame_pos[0] + skip - fade_start) / length, out_gain, in_gain);
+    get_gains(fade_curve, static_cast<f64>(packet.original_frame_pos[0] + skip + mixed - fade_start) / length, out_end, in_end);
+    auto out = reinterpret_cast<f32*>(outgoing_pcm.data());
+    mix_ramp(out, reinterpret_cast<const f32*>(incoming_pcm.data()), mixed, channels, out_gain, (out_end - out_gain) / mixed, in_gain, (in_end - in_gain) / mixed);
+    // Frames after the end of the incoming song fade out alone.
+    for(auto f = mixed; f < faded; ++f) {
+        for(u32 c = 0; c < channels; ++c) {
+            out[f * channels + c] *= out_end;
+        }
+    }
+    convert_samples(outgoing_pcm.data(), native_f32, tail, packet.format.sample_type, faded * channels);
+}
+
+void Crossfader::load() {
+    ms        = 0;
+    curve     = Curve::EQUAL_POWER;
+    from_tags = false;
+    albums    = false;
+    if(nlohmann::json config_data; config::load_configuration(config_data) && type_check("crossfade", JSON_TYPE::OBJECT, config_data)) {
+        auto& section = config_data["crossfade"];
+        if(type_check("ms", JSON_TYPE::NUMBER, section)) ms = section["ms"].get<i64>();
+        if(type_check("curve", JSON_TYPE::STRING, section)) parse_curve(section["curve"].get<std::string>(), curve);
+        if(section.contains("from_tags") && section["from_tags"].is_boolean()) from_tags = section["from_tags"].get<bool>();
+        if(section.contains("albums") && section["albums"].is_boolean()) albums = section["albums"].get<bool>();
+    }
+    reset();
+}
+void Crossfader::reset() {
+    outgoing = nullptr;
+    incoming = nullptr;
+    length   = 0;
+    queue.clear();
+    queue_head     = 0;
+    queued_frames  = 0;
+    head_consumed  = 0;
+    incoming_frame = 0;
+    incoming_ended = false;
+}
+void Crossfader::process(AudioFile& outgoing, AudioFile* incoming, PCMPacketUnit& packet) {
+    if(packet.format.get_sample_bytewidth() == 0 || packet.format.channels == 0 || packet.pcm.empty()) return;
+    if(&outgoing != this->outgoing || incoming != this->incoming) {
+        AllowAllocation allow; // once per song.
+        plan(outgoing, incoming, packet.format.sampling_rate);
+    }
+    if(length == 0) return;
+
+    const auto playable   = outgoing.get_playable_frames();
+    const auto fade_start = playable - length;
+    const auto begin      = packet.original_frame_pos[0];
+    const auto frames     = packet.get_frames();
+    // Decode ahead, one packet of the incoming song per packet of the outgoing song.
+    if(begin + length * 2 >= playable && queued_frames < length) decode_incoming(packet.format);
+    if(begin + frames <= fade_start) return;
+
+    const auto skip = begin < fade_start ? fade_start - begin : 0;
+    while(queued_frames < frames - skip && decode_incoming(packet.format)) {}
+    mix(packet, skip, fade_start);
+}
+n_frames Crossfader::finish(PCMPacket& rest) {
+    for(auto i = queue_head; i < queue.size(); ++i) {
+        auto& unit = queue[i];
+        if(i == queue_head && head_consumed != 0) {
+            const size_t frame_bytes = unit.format.get_sample_bytewidth() * unit.format.channels;
+            unit.pcm.erase(unit.pcm.begin(), unit.pcm.begin() + head_consumed * frame_bytes);
+            unit.original_frame_pos[0] += head_consumed;
+        }
+        rest.emplace_back(std::move(unit));
+    }
+    auto next = incoming_frame;
+    reset();
+    return next;
+}
+} // namespace boxten
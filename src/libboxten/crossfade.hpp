@@ -0,0 +1,58 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <vector>
+
+#include "audiofile.hpp"
+#include "type.hpp"
+
+namespace boxten {
+// Mixes the end of a song into the start of the next one, in the fill thread.
+// Mixed packets keep the positions of the outgoing song, and the next song continues from the fade length
+// after SONG_CHANGE, so that positions never go back.
+// The next song is decoded ahead from twice the fade length before the end, so that the fade itself needs one decode per packet.
+// Configured by "crossfade" section of boxten configuration:
+//   "ms"        fade length. 0 disables crossfades(default).
+//   "curve"     "equal_power"(default) or "linear".
+//   "from_tags" if true, tags "crossfade_ms" and "crossfade_curve" of the outgoing song override them.
+//   "albums"    if false(default), songs of the same album are joined gapless instead.
+class Crossfader {
+  public:
+    enum class Curve {
+        EQUAL_POWER,
+        LINEAR,
+    };
+
+  private:
+    i64   ms        = 0;
+    Curve curve     = Curve::EQUAL_POWER;
+    bool  from_tags = false;
+    bool  albums    = false;
+
+    AudioFile*                 outgoing = nullptr; // the fade is planned between these songs.
+    AudioFile*                 incoming = nullptr;
+    n_frames                   length   = 0; // 0 means no fade.
+    Curve                      fade_curve;
+    std::vector<PCMPacketUnit> queue; // decoded frames of the incoming song.
+    size_t                     queue_head     = 0;
+    n_frames                   queued_frames  = 0;
+    n_frames                   head_consumed  = 0; // frames of queue[queue_head] which were mixed already.
+    n_frames                   incoming_frame = 0; // next frame of the incoming song to decode.
+    bool                       incoming_ended = false;
+    PCMStorage                 outgoing_pcm; // native_f32 work areas.
+    PCMStorage                 incoming_pcm;
+
+    void plan(AudioFile& outgoing, AudioFile* incoming, u32 sampling_rate);
+    bool decode_incoming(const PCMFormat& format);
+    void mix(PCMPacketUnit& packet, n_frames skip, n_frames fade_start);
+
+  public:
+    void load();
+    // Forgets the planned fade, on seeks.
+    void reset();
+    // Mixes the incoming song into packet, if packet is in the fade of the outgoing song.
+    void process(AudioFile& outgoing, AudioFile* incoming, PCMPacketUnit& packet);
+    // Called when the outgoing song ended. Moves the frames decoded ahead but not mixed to 'rest',
+    // and returns the frame of the incoming song to continue from.
+    n_frames finish(PCMPacket& rest);
+};
+} // namespace boxten
@@ -0,0 +1,129 @@
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include "dither.hpp"
+
+namespace boxten {
+namespace {
+constexpr f32 first_order[] = {1.0f};
+constexpr f32 f_weighted[]  = {1.623f, -0.982f, 0.109f};
+constexpr f32 e_weighted[]  = {2.033f, -2.165f, 1.959f, -1.590f, 0.6149f};
+
+inline u32 xorshift(u32& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+// Difference of two uniform values in [0, 1), which has the triangular distribution over (-1, 1) LSB.
+inline f32 tpdf(u32& state) {
+    constexpr f32 unit = 1.0f / 65536.0f;
+    auto          r    = xorshift(state);
+    return static_cast<f32>(r & 0xFFFF) * unit - static_cast<f32>(r >> 16) * unit;
+}
+
+typedef u32 vu32 __attribute__((vector_size(32)));
+typedef i32 vi32 __attribute__((vector_size(32)));
+typedef f32 vf32 __attribute__((vector_size(32)));
+constexpr size_t lanes = sizeof(vf32) / sizeof(f32);
+
+// TPDF without noise shaping has no feedback, so it runs 'lanes' samples at a time.
+size_t dither_flat(f32* samples, size_t count, f32 scale, u32* lane_random) {
+    constexpr f32 unit = 1.0f / 65536.0f;
+    const f32     max  = scale - 1.0f;
+    vu32          state;
+    std::memcpy(&state, lane_random, sizeof(state));
+    size_t i = 0;
+    for(; i + lanes <= count; i += lanes) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        vf32 noise = __builtin_convertvector(state & 0xFFFF, vf32) * unit - __builtin_convertvector(state >> 16, vf32) * unit;
+        vf32 v;
+        std::memcpy(&v, samples + i, sizeof(v));
+        v = v * scale + noise;
+        // Round to nearest. Adding and subtracting 1.5 * 2^23 drops the fraction of values below 2^22.
+        v = (v + 12582912.0f) - 12582912.0f;
+        v = v > max ? max : v;
+        v = v < -scale ? -scale : v;
+        v = v / scale;
+        std::memcpy(samples + i, &v, sizeof(v));
+    }
+    std::memcpy(lane_random, &state, sizeof(state));
+    return i;
+}
+} // namespace
+
+void Ditherer::configure(u32 channels, u32 bits, NoiseShaping shaping) {
+    if(this->channels == channels && this->bits == bits && this->shaping == shaping) return;
+    this->channels = channels;
+    this->bits     = bits;
+    this->shaping  = shaping;
+    states.resize(channels);
+    reset();
+}
+void Ditherer::reset() {
+    // Fixed seeds, different per channel so that the dither of channels is uncorrelated.
+    u32 seed = 0x9E3779B9;
+    for(auto& s : states) {
+        s.random = xorshift(seed);
+        std::fill_n(s.error, max_taps, 0.0f);
+    }
+    for(auto& r : lane_random) {
+        r = xorshift(seed);
+    }
+}
+void Ditherer::process(f32* samples, n_frames frames) {
+    const f32 scale    = std::ldexp(1.0f, bits - 1);
+    const f32 max      = scale - 1.0f;
+    auto      quantize = [&](f32 v) {
+        v = (v + 12582912.0f) - 12582912.0f;
+        return v > max ? max : v < -scale ? -scale : v;
+    };
+
+    const f32* taps  = nullptr;
+    size_t     count = 0;
+    switch(shaping) {
+    case NoiseShaping::NONE: {
+        size_t done = dither_flat(samples, frames * channels, scale, lane_random);
+        for(size_t i = done; i < frames * channels; ++i) {
+            auto& state = states[i % channels];
+            samples[i]  = quantize(samples[i] * scale + tpdf(state.random)) / scale;
+        }
+        return;
+    }
+    case NoiseShaping::FIRST_ORDER:
+        taps  = first_order;
+        count = std::size(first_order);
+        break;
+    case NoiseShaping::F_WEIGHTED:
+        taps  = f_weighted;
+        count = std::size(f_weighted);
+        break;
+    case NoiseShaping::E_WEIGHTED:
+        taps  = e_weighted;
+        count = std::size(e_weighted);
+        break;
+    }
+    // Error feedback: the quantization error of previous samples is subtracted, through the filter.
+    // Channels are processed side by side, so that their feedback loops overlap in the cpu.
+    for(n_frames f = 0; f < frames; ++f) {
+        for(u32 c = 0; c < channels; ++c) {
+            auto& state  = states[c];
+            auto& sample = samples[f * channels + c];
+            f32   wanted = sample * scale;
+            for(size_t t = 0; t < count; ++t) {
+                wanted -= taps[t] * state.error[t];
+            }
+            f32 result = quantize(wanted + tpdf(state.random));
+            for(size_t t = max_taps - 1; t > 0; --t) {
+                state.error[t] = state.error[t - 1];
+            }
+            // Keep the feedback bounded when the signal clips.
+            state.error[0] = std::fmin(std::fmax(result - wanted, -2.0f), 2.0f);
+            sample         = result / scale;
+        }
+    }
+}
+} // namespace boxten
@@ -0,0 +1,34 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <vector>
+
+#include "type.hpp"
+
+namespace boxten {
+enum class NoiseShaping {
+    NONE,        // plain TPDF dither.
+    FIRST_ORDER, // moves noise to high frequencies, with 1 tap.
+    F_WEIGHTED,  // 3 taps, follows the ear's sensitivity(Wannamaker).
+    E_WEIGHTED,  // 5 taps, stronger(Lipshitz).
+};
+// Requantizes interleaved native_f32 to 'bits'(16 or less) with TPDF dither and optional noise shaping.
+// Results stay in f32, but are exactly on the grid of the lower depth, so that convert_samples() does no further rounding.
+class Ditherer {
+  private:
+    static constexpr size_t max_taps = 5;
+    struct Channel {
+        u32 random;
+        f32 error[max_taps]; // the latest first.
+    };
+    u32                  channels = 0;
+    u32                  bits     = 0;
+    NoiseShaping         shaping  = NoiseShaping::NONE;
+    std::vector<Channel> states;
+    alignas(64) u32 lane_random[16]; // states of the vectorized PRNG.
+
+  public:
+    void configure(u32 channels, u32 bits, NoiseShaping shaping);
+    void reset();
+    void process(f32* samples, n_frames frames);
+};
+} // namespace boxten
@@ -5,9 +5,12 @@
 #include "type.hpp"
 
 namespace boxten{
+class SoundProcessor;
+
 enum Events {
     PLAYBACK_CHANGE,
     SONG_CHANGE,
+    PROCESSOR_OVER_BUDGET,
 };
 using HookFunction = std::function<void(Events, void*)>;
 namespace HookParameters {
@@ -19,5 +22,11 @@ struct SongChange {
     i64 old_index;
     i64 new_index;
 };
+// Raised when a SoundProcessor took longer than "dsp_budget" of the duration of a packet. At most once per 5 seconds for each processor.
+struct ProcessorOverBudget {
+    const SoundProcessor* processor; // only for comparison. it may have been removed from the chain already.
+    f64                   realtime_factor;
+    f64                   budget;
+};
 } // namespace Parameters
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include "playback.hpp"
 #include "playlist.hpp"
 #include "plugin.hpp"
+#include "sampleconv.hpp"
+#include "statistics.hpp"
 #include "type.hpp"
 #include "worker.hpp"
 #include "queuethread.hpp"
@@ -0,0 +1,173 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include "debug.hpp"
+#include "pcmpool.hpp"
+#include "statistics.hpp"
+
+namespace boxten {
+namespace {
+constexpr size_t block_alignment = 64;
+constexpr size_t header_bytes    = block_alignment; // keeps the payload aligned.
+constexpr u32    max_blocks      = 1 << 18;
+constexpr u32    heap_block      = 0xFFFFFFFF;
+constexpr size_t blocks_per_slab = 32;
+// Blocks come in several sizes, so that small formats do not waste a whole pcm_block_bytes block per packet.
+// The largest class holds upsampled packets.
+constexpr size_t size_classes              = 5;
+constexpr size_t class_bytes[size_classes] = {pcm_block_bytes / 8, pcm_block_bytes / 4, pcm_block_bytes / 2, pcm_block_bytes, pcm_block_bytes * 4};
+
+struct BlockHeader {
+    u32 index;
+    u32 size_class;
+};
+
+// Lock-free stacks of free block indices. The upper 32 bits of free_head is a tag against ABA problem,
+// the lower 32 bits is (index + 1) of the top block, or 0 if empty.
+std::atomic<u64> free_head[size_classes] = {};
+std::atomic<u32> next_free[max_blocks];
+u8*              blocks[max_blocks];
+std::atomic<u32> block_count = 0;
+std::mutex       grow_lock;
+
+std::atomic<u64> hits             = 0;
+std::atomic<u64> misses           = 0;
+std::atomic<u64> heap_allocs      = 0;
+std::atomic<u64> free_block_count = 0;
+std::atomic<u64> pooled_bytes     = 0;
+
+size_t get_size_class(size_t bytes) {
+    for(size_t c = 0; c < size_classes; ++c) {
+        if(bytes <= class_bytes[c]) return c;
+    }
+    return size_classes;
+}
+void push_block(u32 index, size_t size_class) {
+    auto& head_ref = free_head[size_class];
+    u64   old      = head_ref.load(std::memory_order_relaxed);
+    u64   head;
+    do {
+        next_free[index].store(static_cast<u32>(old), std::memory_order_relaxed);
+        head = (((old >> 32) + 1) << 32) | (index + 1);
+    } while(!head_ref.compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
+    free_block_count.fetch_add(1, std::memory_order_relaxed);
+}
+bool pop_block(u32& index, size_t size_class) {
+    auto& head_ref = free_head[size_class];
+    u64   old      = head_ref.load(std::memory_order_acquire);
+    while(true) {
+        u32 top = static_cast<u32>(old);
+        if(top == 0) return false;
+        u64 head = (((old >> 32) + 1) << 32) | next_free[top - 1].load(std::memory_order_relaxed);
+        if(head_ref.compare_exchange_weak(old, head, std::memory_order_acquire, std::memory_order_acquire)) {
+            index = top - 1;
+            free_block_count.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+}
+u8* allocate_raw(size_t bytes) {
+    return static_cast<u8*>(::operator new(bytes, std::align_val_t(block_alignment)));
+}
+void free_raw(u8* pointer) {
+    ::operator delete(pointer, std::align_val_t(block_alignment));
+}
+// Adds a slab to the pool. Returns false if the pool is full.
+bool grow_pool(size_t count, size_t size_class) {
+    std::lock_guard<std::mutex> lock(grow_lock);
+    u32 first = block_count.load(std::memory_order_relaxed);
+    if(first + count > max_blocks) count = max_blocks - first;
+    if(count == 0) return false;
+
+    const size_t stride = header_bytes + class_bytes[size_class];
+    auto         slab   = allocate_raw(stride * count);
+    for(size_t i = 0; i < count; ++i) {
+        u32 index     = first + i;
+        blocks[index] = slab + stride * i;
+        auto header        = reinterpret_cast<BlockHeader*>(blocks[index]);
+        header->index      = index;
+        header->size_class = size_class;
+    }
+    block_count.store(first + count, std::memory_order_release);
+    pooled_bytes.fetch_add(stride * count, std::memory_order_relaxed);
+    for(size_t i = 0; i < count; ++i) {
+        push_block(first + i, size_class);
+    }
+    return true;
+}
+void* allocate_heap(size_t bytes) {
+    heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    auto raw = allocate_raw(header_bytes + bytes);
+    reinterpret_cast<BlockHeader*>(raw)->index = heap_block;
+    return raw + header_bytes;
+}
+} // namespace
+
+void* allocate_pcm_storage(size_t bytes) {
+    auto size_class = get_size_class(bytes);
+    if(size_class == size_classes) return allocate_heap(bytes);
+
+    u32 index;
+    if(pop_block(index, size_class)) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return blocks[index] + header_bytes;
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    while(!pop_block(index, size_class)) {
+        if(!grow_pool(blocks_per_slab, size_class)) {
+            DEBUG_OUT("pcm pool exhausted.");
+            return allocate_heap(bytes);
+        }
+    }
+    return blocks[index] + header_bytes;
+}
+void free_pcm_storage(void* pointer) {
+    if(pointer == nullptr) return;
+    auto raw    = static_cast<u8*>(pointer) - header_bytes;
+    auto header = reinterpret_cast<BlockHeader*>(raw);
+    if(header->index == heap_block) {
+        free_raw(raw);
+    } else {
+        push_block(header->index, header->size_class);
+    }
+}
+void reserve_pcm_pool(size_t count, size_t bytes) {
+    auto size_class = get_size_class(bytes);
+    if(size_class == size_classes) return;
+    size_t have = 0;
+    {
+        std::lock_guard<std::mutex> lock(grow_lock);
+        auto                        total = block_count.load(std::memory_order_acquire);
+        for(u32 i = 0; i < total; ++i) {
+            if(reinterpret_cast<BlockHeader*>(blocks[i])->size_class == size_class) have++;
+        }
+    }
+    while(have < count) {
+        size_t lack = count - have;
+        size_t grow = lack < blocks_per_slab ? blocks_per_slab : lack;
+        if(!grow_pool(grow, size_class)) break;
+        have += grow;
+    }
+}
+void prefault_pcm_pool() {
+    std::lock_guard<std::mutex> lock(grow_lock);
+    auto                        total = block_count.load(std::memory_order_acquire);
+    for(u32 i = 0; i < total; ++i) {
+        auto           header = reinterpret_cast<BlockHeader*>(blocks[i]);
+        volatile auto* block  = blocks[i] + header_bytes;
+        for(size_t b = 0; b < class_bytes[header->size_class]; b += 4096) block[b] = 0;
+    }
+}
+PCMPoolStatistics get_pcm_pool_statistics() {
+    PCMPoolStatistics result;
+    result.hits         = hits;
+    result.misses       = misses;
+    result.heap_allocs  = heap_allocs;
+    result.blocks       = block_count;
+    result.free_blocks  = free_block_count;
+    result.pooled_bytes = pooled_bytes;
+    return result;
+}
+} // namespace boxten
@@ -0,0 +1,13 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include "type.hpp"
+
+namespace boxten {
+// The largest pooled block. Large enough for a PCMPACKET_PERIOD of 8 channel 32bit samples.
+constexpr size_t pcm_block_bytes = PCMPACKET_PERIOD * 8 * 4;
+
+// Makes sure that the pool owns at least 'blocks' blocks which can hold 'bytes' bytes. Not realtime safe.
+void reserve_pcm_pool(size_t blocks, size_t bytes = pcm_block_bytes);
+// Writes to every pooled block, so that they are backed by physical memory.
+void prefault_pcm_pool();
+} // namespace boxten
@@ -0,0 +1,574 @@
+#include <cstdio>
+
+#include "pipeline.hpp"
+#include "configuration.hpp"
+#include "eventhook_internal.hpp"
+#include "jsontest.hpp"
+#include "realtime.hpp"
+#include "sampleconv.hpp"
+#include "threadpolicy.hpp"
+
+namespace boxten {
+namespace {
+bool contains(const std::vector<u32>& list, u32 value) {
+    for(auto v : list) {
+        if(v == value) return true;
+    }
+    return false;
+}
+bool is_float(SampleType type) {
+    return type == SampleType::f32_le || type == SampleType::f32_be;
+}
+// Effective depth of samples. f32 carries 24 bits of mantissa.
+u32 sample_bits(SampleType type) {
+    return is_float(type) ? 24 : get_sample_bytewidth(type) * 8;
+}
+// Picks the sampling rate or the channels to convert 'value' to. 'preferred' is taken if accepted, to avoid switching formats.
+u32 choose_value(const std::vector<u32>& accepted, u32 preferred, u32 value) {
+    if(accepted.empty() || contains(accepted, value)) return value;
+    if(contains(accepted, preferred)) return preferred;
+    // The lowest one which is not lower than value, or the highest one.
+    u32 higher  = 0;
+    u32 highest = 0;
+    for(auto v : accepted) {
+        if(v >= value && (higher == 0 || v < higher)) higher = v;
+        if(v > highest) highest = v;
+    }
+    return higher != 0 ? higher : highest;
+}
+} // namespace
+
+void Pipeline::apply_mode(Chain& chain) {
+    for(auto& s : chain.stages) {
+        s.capabilities = s.declared;
+        s.plan         = Plan();
+        if(mode == Mode::NATIVE || !s.declared.sample_types.empty()) continue;
+        s.capabilities.sample_types = {native_f32};
+        s.capabilities.planar       = mode == Mode::FLOAT_PLANAR;
+    }
+}
+void Pipeline::apply_mode() {
+    // Only while the fill thread is not running.
+    for(auto& c : chains) {
+        apply_mode(*c);
+        split(*c);
+    }
+    output_plan = Plan();
+}
+void Pipeline::split(Chain& chain) {
+    const auto count = groups.empty() ? threads : groups.size();
+    const auto size  = chain.stages.size();
+    chain.ranges.clear();
+    size_t begin = 0;
+    for(size_t i = 0; i < count; ++i) {
+        size_t end;
+        if(i + 1 == count) {
+            end = size;
+        } else if(groups.empty()) {
+            // Split evenly. Former groups take the remainder.
+            end = begin + size / count + (i < size % count ? 1 : 0);
+        } else {
+            end = begin + std::min<size_t>(groups[i], size - begin);
+        }
+        chain.ranges.emplace_back(begin, end);
+        begin = end;
+    }
+}
+void Pipeline::reclaim() {
+    // A chain older than the active one is not given to new packets. Free it once the packets which have it are done.
+    const auto active    = active_epoch.load();
+    const auto idle      = in_flight.load() == 0;
+    const auto completed = completed_epoch.load();
+    for(auto c = chains.begin(); c != chains.end();) {
+        if((*c)->epoch < active && (idle || (*c)->epoch < completed)) {
+            c = chains.erase(c);
+        } else {
+            c += 1;
+        }
+    }
+    for(auto p = profiles.begin(); p != profiles.end();) {
+        auto used = false;
+        for(auto& c : chains) {
+            for(auto& s : c->stages) {
+                used |= s.processor == p->first;
+            }
+        }
+        if(!used) {
+            p = profiles.erase(p);
+        } else {
+            p = std::next(p);
+        }
+    }
+}
+size_t Pipeline::count_accepting_stages(const Chain& chain, size_t from, SampleType type, bool planar) {
+    // Formats are only predictable while processors are in-place.
+    const auto& stages = chain.stages;
+    size_t      count  = 0;
+    for(auto i = from; i < stages.size() && stages[i].in_place; ++i) {
+        if(i + 1 == stages.size()) {
+            if(!planar && output_capabilities.accepts_sample_type(type)) count += 1;
+            break;
+        }
+        auto& next = stages[i + 1].capabilities;
+        if(next.planar != planar || !next.accepts_sample_type(type)) break;
+        count += 1;
+    }
+    return count;
+}
+PCMFormat Pipeline::plan_stage(const Chain& chain, size_t index, const PCMFormat& input) {
+    auto& capabilities   = chain.stages[index].capabilities;
+    auto  result         = input;
+    result.sampling_rate = choose_value(capabilities.sampling_rates, 0, input.sampling_rate);
+    result.channels      = choose_value(capabilities.channels, 0, input.channels);
+    if(input.planar == capabilities.planar && capabilities.accepts_sample_type(input.sample_type)) return result;
+
+    // Choose the type which the longest run of following stages accepts as well, so that they need no conversion.
+    result.planar = capabilities.planar;
+    i64  best     = -1;
+    auto consider = [&](SampleType type) {
+        auto score = static_cast<i64>(count_accepting_stages(chain, index, type, capabilities.planar));
+        if(score <= best) return;
+        best               = score;
+        result.sample_type = type;
+    };
+    if(capabilities.planar) {
+        consider(native_f32);
+    } else if(capabilities.sample_types.empty()) {
+        consider(input.sample_type);
+    } else {
+        for(auto t : capabilities.sample_types) {
+            consider(t);
+        }
+    }
+    return result;
+}
+PCMFormat Pipeline::plan_output(const PCMFormat& input, SampleType source) {
+    auto result          = input;
+    result.planar        = false;
+    result.sampling_rate = choose_value(output_capabilities.sampling_rates, output_rate, input.sampling_rate);
+    result.channels      = choose_value(output_capabilities.channels, output_channels, input.channels);
+    if(output_capabilities.sample_types.empty()) {
+        // The output takes anything. Give it what StreamInput produced.
+        result.sample_type = mode == Mode::NATIVE ? input.sample_type : source;
+        return result;
+    }
+    const auto width = get_sample_bytewidth(input.sample_type);
+    if(output_capabilities.accepts_sample_type(output_type) && get_sample_bytewidth(output_type) >= width) {
+        // Keep the current type as long as it loses nothing, so that the output need not reopen the device.
+        result.sample_type = output_type;
+    } else if(output_capabilities.accepts_sample_type(input.sample_type)) {
+        result.sample_type = input.sample_type;
+    } else {
+        result.sample_type = output_capabilities.sample_types[0];
+        for(auto t : output_capabilities.sample_types) {
+            if(get_sample_bytewidth(t) > get_sample_bytewidth(result.sample_type)) result.sample_type = t;
+        }
+    }
+    return result;
+}
+void Pipeline::convert_layout(PCMPacketUnit& packet, SampleType type, bool planar, PCMStorage& scratch) {
+    auto& format = packet.format;
+    if(format.sample_type == type && format.planar == planar) return;
+    if(format.planar) {
+        scratch.resize(packet.pcm.size());
+        interleave_samples(reinterpret_cast<const f32*>(packet.pcm.data()), reinterpret_cast<f32*>(scratch.data()), format.channels, packet.get_frames());
+        packet.pcm.swap(scratch);
+        format.planar = false;
+    }
+    if(format.sample_type != type) {
+        const size_t samples = packet.pcm.size() / format.get_sample_bytewidth();
+        scratch.resize(samples * get_sample_bytewidth(type));
+        convert_samples(packet.pcm.data(), format.sample_type, scratch.data(), type, samples);
+        packet.pcm.swap(scratch);
+        format.sample_type = type;
+    }
+    if(planar) {
+        scratch.resize(packet.pcm.size());
+        deinterleave_samples(reinterpret_cast<const f32*>(packet.pcm.data()), reinterpret_cast<f32*>(scratch.data()), format.channels, packet.get_frames());
+        packet.pcm.swap(scratch);
+        format.planar = true;
+    }
+}
+void Pipeline::remix(PCMPacketUnit& packet, Remixer& remixer, u32 channels, PCMStorage& scratch) {
+    convert_layout(packet, native_f32, false, scratch);
+    const auto frames = packet.get_frames();
+    scratch.resize(frames * channels * sizeof(f32));
+    remixer.process(reinterpret_cast<const f32*>(packet.pcm.data()), frames, reinterpret_cast<f32*>(scratch.data()));
+    packet.pcm.swap(scratch);
+    packet.format.channels = channels;
+}
+void Pipeline::resample(PCMPacketUnit& packet, Resampler& resampler, u32 sampling_rate, bool flush, PCMStorage& scratch) {
+    convert_layout(packet, native_f32, false, scratch);
+    const auto frames   = packet.get_frames();
+    const auto channels = packet.format.channels;
+    scratch.resize(resampler.max_output_frames(frames, flush) * channels * sizeof(f32));
+    auto written = resampler.process(reinterpret_cast<const f32*>(packet.pcm.data()), frames, reinterpret_cast<f32*>(scratch.data()), flush);
+    scratch.resize(written * channels * sizeof(f32));
+    packet.pcm.swap(scratch);
+    packet.format.sampling_rate = sampling_rate;
+}
+void Pipeline::prepare(const Plan& plan, Converters& converters) {
+    const auto& input  = plan.input;
+    const auto& target = plan.target;
+    if(input.channels != target.channels) {
+        std::vector<f32> matrix;
+        if(auto m = matrices.find({input.channels, target.channels}); m != matrices.end()) matrix = m->second;
+        converters.remixer.configure(input.channels, target.channels, matrix);
+    }
+    if(input.sampling_rate != target.sampling_rate) {
+        // Resampling runs on the fewer channels.
+        converters.resampler.configure(input.sampling_rate, target.sampling_rate, std::min(input.channels, target.channels), quality);
+    }
+    if(plan.dither) {
+        converters.ditherer.configure(target.channels, sample_bits(target.sample_type), shaping);
+    }
+}
+void Pipeline::convert(PCMPacketUnit& packet, const Plan& plan, Converters& converters, bool flush, PCMStorage& scratch) {
+    const auto& target = plan.target;
+    auto&       format = packet.format;
+    if(format.channels > target.channels) remix(packet, converters.remixer, target.channels, scratch);
+    if(format.sampling_rate != target.sampling_rate) resample(packet, converters.resampler, target.sampling_rate, flush, scratch);
+    if(format.channels != target.channels) remix(packet, converters.remixer, target.channels, scratch);
+    if(plan.dither) {
+        convert_layout(packet, native_f32, false, scratch);
+        converters.ditherer.process(reinterpret_cast<f32*>(packet.pcm.data()), packet.get_frames());
+    }
+    convert_layout(packet, target.sample_type, target.planar, scratch);
+}
+void Pipeline::modify(Stage& stage, PCMPacketUnit& packet) {
+    const auto call = [&]() {
+        if(stage.in_place) {
+            PCMBlock block{packet.format, {packet.original_frame_pos[0], packet.original_frame_pos[1]}, packet.pcm.data(), packet.get_frames(), &packet, stage.discontinuous};
+            stage.discontinuous = false;
+            stage.processor->modify_block(block);
+        } else {
+            stage.processor->modify_packet(packet);
+        }
+    };
+    if(!profile) {
+        call();
+        return;
+    }
+    const auto audio_ns  = packet_duration_ns(packet);
+    const auto cpu_begin = thread_cpu_time_ns();
+    const auto begin     = read_cycles();
+    call();
+    const auto end     = read_cycles();
+    const auto cpu_end = thread_cpu_time_ns();
+    const auto wall_ns = cycles_to_ns(end - begin);
+    if(!stage.profile->record(wall_ns, cpu_end - cpu_begin, audio_ns, budget, cycles_to_ns(end))) return;
+    AllowAllocation allow; // at most once per 5 seconds.
+    invoke_eventhook(Events::PROCESSOR_OVER_BUDGET, new HookParameters::ProcessorOverBudget{stage.processor, static_cast<f64>(wall_ns) / audio_ns, budget});
+}
+void Pipeline::reset(Chain& chain, size_t begin, size_t end, bool output) {
+    for(auto i = begin; i < end; ++i) {
+        chain.stages[i].converters.resampler.reset();
+        chain.stages[i].discontinuous = true;
+    }
+    if(output) output_converters.resampler.reset();
+}
+void Pipeline::run(PCMPacketUnit& packet, SampleType source, Chain& chain, size_t begin, size_t end, bool output, bool flush, PCMStorage& scratch) {
+    auto& stages = chain.stages;
+    if(packet.format.get_sample_bytewidth() == 0 || packet.format.channels == 0) {
+        for(auto i = begin; i < end; ++i) {
+            stages[i].processor->modify_packet(packet);
+        }
+        return;
+    }
+    for(auto i = begin; i < end; ++i) {
+        auto& stage = stages[i];
+        if(stage.plan.input != packet.format) {
+            AllowAllocation allow; // only when the format changes, or a new chain is published.
+            stage.plan.input  = packet.format;
+            stage.plan.target = plan_stage(chain, i, packet.format);
+            prepare(stage.plan, stage.converters);
+        }
+        convert(packet, stage.plan, stage.converters, flush, scratch);
+        modify(stage, packet);
+    }
+    if(!output || packet.format.get_sample_bytewidth() == 0) return;
+    if(output_plan.input != packet.format || output_plan.source != source) {
+        AllowAllocation allow;
+        output_plan.input  = packet.format;
+        output_plan.source = source;
+        output_plan.target = plan_output(packet.format, source);
+        // Requantize with dither only when the output is shallower than what the pipeline carries.
+        const auto bits    = sample_bits(output_plan.target.sample_type);
+        output_plan.dither = dither && !is_float(output_plan.target.sample_type) && bits <= 16 && bits < sample_bits(packet.format.sample_type);
+        prepare(output_plan, output_converters);
+    }
+    convert(packet, output_plan, output_converters, flush, scratch);
+    output_type     = packet.format.sample_type;
+    output_rate     = packet.format.sampling_rate;
+    output_channels = packet.format.channels;
+}
+void Pipeline::complete(const Chain& chain) {
+    completed_epoch.store(chain.epoch);
+    if(in_flight.fetch_sub(1) != 1) return;
+    {
+        std::lock_guard<std::mutex> lock(drain_lock);
+    }
+    drained.notify_all();
+}
+void Pipeline::push(Segment& segment, Item&& item) {
+    item.queued_ns = steady_time_ns();
+    while(!segment.queue.push(std::move(item))) {
+        std::unique_lock<std::mutex> lock(segment.lock);
+        segment.changed.wait(lock, [&]() { return !segment.queue.full() || segment.finish; });
+        if(segment.finish) return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(segment.lock);
+    }
+    segment.changed.notify_all();
+}
+void Pipeline::run_segment(size_t index) {
+    apply_thread_policy(AudioThread::DSP);
+    if(realtime) prefault_stack(64 * 1024);
+    RealtimeSection realtime_section(realtime);
+    auto&           segment = *segments[index];
+    const bool      last    = index + 1 == segments.size();
+    while(true) {
+        auto item = segment.queue.front();
+        if(item == nullptr) {
+            std::unique_lock<std::mutex> lock(segment.lock);
+            segment.changed.wait(lock, [&]() { return !segment.queue.empty() || segment.finish; });
+            if(segment.finish) break;
+            continue;
+        }
+        const auto start = steady_time_ns();
+        segment.queue_time.record(start - item->queued_ns);
+        auto& chain       = *item->chain;
+        auto [begin, end] = chain.ranges[index];
+        if(item->generation != segment.generation) {
+            reset(chain, begin, end, last);
+            segment.generation = item->generation;
+        }
+        run(item->packet, item->source, chain, begin, end, last, item->flush, segment.scratch);
+        segment.process_time.record(steady_time_ns() - start);
+        if(last) {
+            sink(std::move(item->packet), item->generation);
+            complete(chain);
+        } else {
+            push(*segments[index + 1], std::move(*item));
+        }
+        // Destruct the packet here, not when the slot is overwritten by the producer.
+        item->packet = PCMPacketUnit();
+        segment.queue.pop();
+        {
+            std::lock_guard<std::mutex> lock(segment.lock);
+        }
+        segment.changed.notify_all();
+    }
+}
+void Pipeline::start_threads() {
+    const auto count = groups.empty() ? threads : groups.size();
+    for(size_t i = 0; i < count; ++i) {
+        auto segment = std::make_unique<Segment>();
+        segment->queue.resize(queue_packets);
+        segments.emplace_back(std::move(segment));
+    }
+    for(size_t i = 0; i < segments.size(); ++i) {
+        segments[i]->thread = Worker(std::bind(&Pipeline::run_segment, this, i));
+    }
+}
+void Pipeline::finish_threads() {
+    for(auto& s : segments) {
+        {
+            std::lock_guard<std::mutex> lock(s->lock);
+            s->finish = true;
+        }
+        s->changed.notify_all();
+    }
+    for(auto& s : segments) {
+        s->thread.join();
+    }
+    segments.clear(); // packets in flight are dropped.
+    in_flight = 0;
+}
+void Pipeline::set_processors(const std::vector<SoundProcessor*>& processors) {
+    auto chain   = std::make_unique<Chain>();
+    chain->epoch = next_epoch++;
+    for(auto p : processors) {
+        // Keep the profile of processors which stay in the chain.
+        auto& profile = profiles[p];
+        if(!profile) profile = std::make_unique<Profile>();
+        chain->stages.emplace_back(Stage{p, p->get_capabilities(), FormatCapabilities(), p->is_in_place(), profile.get(), Plan(), Converters(), false});
+    }
+    apply_mode(*chain);
+    split(*chain);
+    auto published = chain.get();
+    chains.emplace_back(std::move(chain));
+    if(auto skipped = pending.exchange(published); skipped != nullptr) {
+        // Replaced before the fill thread saw it.
+        for(auto c = chains.begin(); c != chains.end(); ++c) {
+            if(c->get() != skipped) continue;
+            chains.erase(c);
+            break;
+        }
+    }
+    reclaim();
+}
+void Pipeline::set_output(StreamOutput& output) {
+    output_capabilities = output.get_supported_formats();
+    output_type         = SampleType::unknown;
+    output_rate         = 0;
+    output_channels     = 0;
+    apply_mode();
+}
+size_t Pipeline::max_output_frame_bytes() const {
+    size_t width = output_capabilities.sample_types.empty() ? 4 : 0;
+    for(auto t : output_capabilities.sample_types) {
+        width = std::max(width, get_sample_bytewidth(t));
+    }
+    u32 channels = output_capabilities.channels.empty() ? 2 : 0;
+    for(auto c : output_capabilities.channels) {
+        channels = std::max(channels, c);
+    }
+    return width * channels;
+}
+void Pipeline::set_sink(Sink sink) {
+    this->sink = sink;
+}
+void Pipeline::load() {
+    mode    = Mode::NATIVE;
+    quality = ResamplerQuality::MEDIUM;
+    dither  = true;
+    shaping = NoiseShaping::NONE;
+    nlohmann::json config_data;
+    if(config::load_configuration(config_data) && type_check("dsp_format", JSON_TYPE::STRING, config_data)) {
+        auto name = config_data["dsp_format"].get<std::string>();
+        if(name == "float") {
+            mode = Mode::FLOAT;
+        } else if(name == "float_planar") {
+            mode = Mode::FLOAT_PLANAR;
+        }
+    }
+    matrices.clear();
+    if(config_data.is_object() && type_check("channel_matrices", JSON_TYPE::OBJECT, config_data)) {
+        // "<inputs>x<outputs>": [[gains of output 0], [gains of output 1], ...]
+        for(auto& m : config_data["channel_matrices"].items()) {
+            u32 inputs, outputs;
+            if(std::sscanf(m.key().data(), "%ux%u", &inputs, &outputs) != 2 || !m.value().is_array() || m.value().size() != outputs) continue;
+            std::vector<f32> matrix;
+            for(auto& row : m.value()) {
+                if(!row.is_array() || row.size() != inputs) break;
+                for(auto& gain : row) {
+                    matrix.emplace_back(gain.is_number() ? gain.get<f32>() : 0.0f);
+                }
+            }
+            if(matrix.size() == inputs * outputs) matrices[{inputs, outputs}] = std::move(matrix);
+        }
+    }
+    if(config_data.is_object() && type_check("resampler", JSON_TYPE::STRING, config_data)) {
+        auto name = config_data["resampler"].get<std::string>();
+        if(name == "fast") {
+            quality = ResamplerQuality::FAST;
+        } else if(name == "best") {
+            quality = ResamplerQuality::BEST;
+        }
+    }
+    threads       = 0;
+    queue_packets = 4;
+    groups.clear();
+    if(config_data.is_object() && type_check("dsp_threads", JSON_TYPE::NUMBER, config_data)) {
+        threads = config_data["dsp_threads"].get<u32>();
+    }
+    if(config_data.is_object() && array_type_check("dsp_groups", JSON_TYPE::NUMBER, config_data)) {
+        for(auto& g : config_data["dsp_groups"]) {
+            groups.emplace_back(g.get<u32>());
+        }
+    }
+    if(config_data.is_object() && type_check("dsp_queue_packets", JSON_TYPE::NUMBER, config_data)) {
+        queue_packets = std::max<size_t>(config_data["dsp_queue_packets"].get<size_t>(), 1);
+    }
+    profile = !config_data.is_object() || config_data.value("dsp_profile", true);
+    budget  = 0.25;
+    if(config_data.is_object() && type_check("dsp_budget", JSON_TYPE::NUMBER, config_data)) {
+        budget = config_data["dsp_budget"].get<f64>();
+    }
+    if(config_data.is_object() && type_check("dither", JSON_TYPE::STRING, config_data)) {
+        auto name = config_data["dither"].get<std::string>();
+        if(name == "off") {
+            dither = false;
+        } else if(name == "first_order") {
+            shaping = NoiseShaping::FIRST_ORDER;
+        } else if(name == "f_weighted") {
+            shaping = NoiseShaping::F_WEIGHTED;
+        } else if(name == "e_weighted") {
+            shaping = NoiseShaping::E_WEIGHTED;
+        }
+    }
+    apply_mode();
+}
+void Pipeline::start(bool realtime) {
+    if(running) stop();
+    this->realtime = realtime;
+    running        = true;
+    for(auto& p : profiles) {
+        p.second->reset();
+    }
+    start_threads();
+}
+void Pipeline::stop() {
+    finish_threads();
+    running = false;
+    reclaim();
+}
+void Pipeline::process(PCMPacketUnit&& packet, u64 generation, bool flush) {
+    if(auto chain = pending.exchange(nullptr); chain != nullptr) {
+        if(!segments.empty()) {
+            // A processor may move to another segment in the new chain. Let the older packets leave the pipeline first.
+            std::unique_lock<std::mutex> lock(drain_lock);
+            drained.wait(lock, [&]() { return in_flight.load() == 0; });
+        }
+        active = chain;
+        active_epoch.store(chain->epoch);
+    }
+    in_flight.fetch_add(1);
+    const auto source = packet.format.sample_type;
+    if(segments.empty()) {
+        if(generation != this->generation) {
+            reset(*active, 0, active->stages.size(), true);
+            this->generation = generation;
+        }
+        run(packet, source, *active, 0, active->stages.size(), true, flush, scratch);
+        sink(std::move(packet), generation);
+        complete(*active);
+        return;
+    }
+    push(*segments[0], Item{active, std::move(packet), source, generation, flush, 0});
+}
+std::vector<DSPThreadStatistics> Pipeline::get_statistics() {
+    std::vector<DSPThreadStatistics> result;
+    reclaim();
+    for(size_t i = 0; i < segments.size(); ++i) {
+        auto&               s     = segments[i];
+        auto&               range = chains.back()->ranges[i]; // of the latest chain.
+        DSPThreadStatistics stats;
+        stats.first_stage    = range.first;
+        stats.stages         = range.second - range.first;
+        stats.queue_capacity = s->queue.capacity();
+        stats.queued         = s->queue.size();
+        stats.process_time   = s->process_time.get();
+        stats.queue_time     = s->queue_time.get();
+        result.emplace_back(stats);
+    }
+    return result;
+}
+std::vector<ProcessorStatistics> Pipeline::get_processor_statistics() {
+    std::vector<ProcessorStatistics> result;
+    reclaim();
+    auto& stages = chains.back()->stages;
+    for(size_t i = 0; i < stages.size(); ++i) {
+        result.emplace_back(ProcessorStatistics{stages[i].processor, i, stages[i].profile->get()});
+    }
+    return result;
+}
+Pipeline::Pipeline() {
+    // Start with an empty chain, so that the fill thread always has one.
+    chains.emplace_back(std::make_unique<Chain>());
+    chains.back()->epoch = 0;
+    active               = chains.back().get();
+}
+} // namespace boxten
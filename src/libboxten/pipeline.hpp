@@ -0,0 +1,176 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "counter.hpp"
+#include "dither.hpp"
+#include "plugin.hpp"
+#include "profiler.hpp"
+#include "remixer.hpp"
+#include "resampler.hpp"
+#include "ringbuffer.hpp"
+#include "statistics.hpp"
+#include "type.hpp"
+#include "worker.hpp"
+
+namespace boxten {
+// Runs the SoundProcessor chain, converting packets to the formats which each stage accepts.
+// The conversion of each stage is planned when its input format changes, and cached until then.
+// Processors which accept any sample type get the format selected by "dsp_format" of boxten configuration:
+//   "native"       packets are passed as they are(default).
+//   "float"        interleaved native_f32.
+//   "float_planar" planar native_f32.
+// Sampling rates are converted when a stage does not accept the rate, with the "resampler" preset("fast", "medium"(default) or "best").
+// Channels are remixed likewise, with the matrices in "channel_matrices" or Remixer::default_matrix().
+// Packets are dithered when the output takes 16 bits or less and the pipeline carries more.
+// "dither" is "tpdf"(default), "first_order", "f_weighted", "e_weighted"(with noise shaping) or "off".
+// With "dsp_threads": N, the chain is split into N groups of consecutive stages, each of which runs on its own thread,
+// connected by queues of "dsp_queue_packets"(default 4) packets. "dsp_groups": [sizes of groups] splits it explicitly.
+// The output conversion runs in the last group. Otherwise the whole chain runs on the fill thread(default).
+// Only the fill thread calls process(). Processed packets are passed to the sink in order.
+// Other functions are called under the lock of SafeVar<Pipeline>, which process() does not take.
+// set_processors() publishes a new chain while process() keeps running. The fill thread switches to it at the next packet,
+// and the old one is freed once no packet in flight uses it. Removed processors may be used until then.
+// In the pipelined mode, stages of the new chain may belong to other threads than before. The fill thread waits for the
+// packets of older chains to leave the pipeline before it queues the first packet of the new one, so that no processor runs on two threads at once.
+// A chain swap therefore blocks the fill thread until the pipeline drains, which takes as long as the queued packets take to be processed.
+// See benchmark/chainswap.cpp.
+// Every call to a processor is timed unless "dsp_profile" is false. A processor which takes longer than "dsp_budget"(default 0.25)
+// of the duration of a packet raises Events::PROCESSOR_OVER_BUDGET. 0 disables the warning.
+class Pipeline {
+  private:
+    enum class Mode {
+        NATIVE,
+        FLOAT,
+        FLOAT_PLANAR,
+    };
+    struct Plan {
+        PCMFormat  input  = {SampleType::unknown, 0, 0};
+        SampleType source = SampleType::unknown; // used by the output stage only.
+        PCMFormat  target = {SampleType::unknown, 0, 0};
+        bool       dither = false; // used by the output stage only.
+    };
+    struct Converters {
+        Resampler resampler;
+        Remixer   remixer;
+        Ditherer  ditherer;
+    };
+    struct Stage {
+        SoundProcessor*    processor;
+        FormatCapabilities declared;     // what the processor returned.
+        FormatCapabilities capabilities; // declared + dsp_format.
+        bool               in_place;
+        Profile*           profile; // owned by the pipeline. shared by the chains which have the same processor.
+        Plan               plan;
+        Converters         converters;
+        bool               discontinuous = false; // set by reset(), and passed to the next block.
+    };
+    // Immutable list of processors. Only the threads which run its stages touch their plans and converters.
+    struct Chain {
+        u64                                    epoch;
+        std::vector<Stage>                     stages;
+        std::vector<std::pair<size_t, size_t>> ranges; // stages run by each thread in the pipelined mode.
+    };
+    struct Item {
+        Chain*        chain;
+        PCMPacketUnit packet;
+        SampleType    source;     // the type StreamInput produced.
+        u64           generation; // a new generation drops the state kept for the stream.
+        bool          flush;      // the last packet of the stream.
+        u64           queued_ns;
+    };
+    // A group of stages which runs on its own thread.
+    struct Segment {
+        SPSCRing<Item>          queue; // input of this segment.
+        std::mutex              lock;  // only for sleeping. the queue itself is lock-free.
+        std::condition_variable changed;
+        bool                    finish     = false;
+        u64                     generation = 0;
+        PCMStorage              scratch;
+        LatencyCounter          process_time;
+        LatencyCounter          queue_time;
+        Worker                  thread;
+    };
+    using Sink     = std::function<void(PCMPacketUnit&&, u64)>;
+    using Profiles = std::map<SoundProcessor*, std::unique_ptr<Profile>>;
+    Mode                                            mode    = Mode::NATIVE;
+    ResamplerQuality                                quality = ResamplerQuality::MEDIUM;
+    bool                                            dither  = true;
+    NoiseShaping                                    shaping = NoiseShaping::NONE;
+    std::map<std::pair<u32, u32>, std::vector<f32>> matrices; // {inputs, outputs} -> Remixer matrix.
+    std::vector<std::unique_ptr<Chain>>             chains;       // published and not freed yet. owned by the writer.
+    Profiles                                        profiles;     // of the processors in the chains.
+    u64                                             next_epoch = 1;
+    std::atomic<Chain*>                             pending    = nullptr; // published, but not picked up by the fill thread yet.
+    Chain*                                          active     = nullptr; // used by the fill thread.
+    std::atomic<u64>                                active_epoch    = 0;
+    std::atomic<u64>                                completed_epoch = 0; // of the latest packet passed to the sink.
+    std::atomic<u64>                                in_flight       = 0; // packets in process().
+    std::mutex                                      drain_lock; // only for sleeping until in_flight reaches 0.
+    std::condition_variable                         drained;
+    FormatCapabilities                              output_capabilities;
+    Plan                                            output_plan;
+    Converters                                      output_converters;
+    SampleType                                      output_type     = SampleType::unknown; // format of the last packet sent to the output.
+    u32                                             output_rate     = 0;
+    u32                                             output_channels = 0;
+    PCMStorage                                      scratch;    // for the synchronous mode.
+    u64                                             generation = 0; // for the synchronous mode.
+    u32                                             threads    = 0;
+    std::vector<u32>                                groups;
+    size_t                                          queue_packets = 4;
+    std::vector<std::unique_ptr<Segment>>           segments; // empty in the synchronous mode.
+    bool                                            running  = false;
+    bool                                            realtime = false;
+    bool                                            profile  = true;
+    f64                                             budget   = 0.25; // realtime factor.
+    Sink                                            sink;
+
+    void      apply_mode(Chain& chain);
+    void      apply_mode();
+    void      split(Chain& chain);
+    void      reclaim();
+    size_t    count_accepting_stages(const Chain& chain, size_t from, SampleType type, bool planar);
+    PCMFormat plan_stage(const Chain& chain, size_t index, const PCMFormat& input);
+    PCMFormat plan_output(const PCMFormat& input, SampleType source);
+    void      convert_layout(PCMPacketUnit& packet, SampleType type, bool planar, PCMStorage& scratch);
+    void      remix(PCMPacketUnit& packet, Remixer& remixer, u32 channels, PCMStorage& scratch);
+    void      resample(PCMPacketUnit& packet, Resampler& resampler, u32 sampling_rate, bool flush, PCMStorage& scratch);
+    void      prepare(const Plan& plan, Converters& converters);
+    void      convert(PCMPacketUnit& packet, const Plan& plan, Converters& converters, bool flush, PCMStorage& scratch);
+    void      modify(Stage& stage, PCMPacketUnit& packet);
+    void      reset(Chain& chain, size_t begin, size_t end, bool output);
+    void      run(PCMPacketUnit& packet, SampleType source, Chain& chain, size_t begin, size_t end, bool output, bool flush, PCMStorage& scratch);
+    void      complete(const Chain& chain);
+    void      push(Segment& segment, Item&& item);
+    void      run_segment(size_t index);
+    void      start_threads();
+    void      finish_threads();
+
+  public:
+    void set_processors(const std::vector<SoundProcessor*>& processors);
+    void set_output(StreamOutput& output);
+    void set_sink(Sink sink);
+    // The largest frame which can be passed to the output, in bytes. Lists which the output left empty are taken as stereo 32bit.
+    size_t max_output_frame_bytes() const;
+    void   load();
+    // Starts the threads of the pipelined mode. 'realtime' runs them in RealtimeSection.
+    void start(bool realtime);
+    // Stops the threads. Packets in flight are dropped.
+    void stop();
+    // Packets of a new generation drop the state kept for the previous ones, such as resampler history.
+    // 'flush' marks the last packet of the stream, which pushes out the frames kept by converters, such as the tail of resamplers.
+    // In the pipelined mode, this returns when the packet is queued. It waits while the queue is full,
+    // and after a chain swap, until the packets of the older chains leave the pipeline.
+    void process(PCMPacketUnit&& packet, u64 generation, bool flush = false);
+    // Empty in the synchronous mode.
+    std::vector<DSPThreadStatistics> get_statistics();
+    std::vector<ProcessorStatistics> get_processor_statistics();
+    Pipeline();
+};
+} // namespace boxten
@@ -1,33 +1,63 @@
+#include <algorithm>
 #include <chrono>
+#include <ctime>
 #include <fcntl.h>
 #include <mutex>
 
 #include "buffer.hpp"
+#include "buffersizer.hpp"
+#include "configuration.hpp"
 #include "console.hpp"
+#include "crossfade.hpp"
 #include "debug.hpp"
 #include "eventhook_internal.hpp"
+#include "jsontest.hpp"
+#include "pcmpool.hpp"
+#include "pipeline.hpp"
 #include "playback.hpp"
 #include "playback_internal.hpp"
 #include "plugin.hpp"
+#include "prefetch.hpp"
+#include "profiler.hpp"
+#include "realtime.hpp"
+#include "sampleconv.hpp"
+#include "statistics.hpp"
+#include "threadpolicy.hpp"
 #include "type.hpp"
 #include "worker.hpp"
 
 namespace boxten {
 namespace {
+ConsoleSet console("[playback] ");
+
+constexpr size_t max_reserved_pool_bytes = 64 * 1024 * 1024; // pcm pool reserved up front when "realtime_memory" is on.
+
 StreamInput*                          stream_input  = nullptr;
+std::recursive_mutex                  input_lock; // see get_input_lock().
 StreamOutput*                         stream_output = nullptr;
-SafeVar<std::vector<SoundProcessor*>> dsp_chain;
+SafeVar<Pipeline>                     pipeline; // DSP chain and format conversions. the fill thread calls process() without the lock.
 Playlist*                             playing_playlist = nullptr;
 
-Buffer buffer;
-bool   playback_starting = false; // if true, playback is started but stream_output->start_playback() has not called yet.
-bool   playback_frozen   = false; // if true, stream_output->pause_playback() was called in order to wait buffer filled after underrun.
-void   buffer_underrun_handler() {
+Buffer      buffer;
+BufferSizer buffer_sizer;
+Crossfader  crossfader; // owned by the fill thread. others lock decode_lock to touch it.
+Prefetcher  prefetcher;
+Profile     decoder_profile; // StreamInput::read_frames().
+bool        profiling         = true; // "dsp_profile" of boxten configuration.
+bool        playback_starting = false; // if true, playback is started but stream_output->start_playback() has not called yet.
+bool        playback_frozen   = false; // if true, stream_output->pause_playback() was called in order to wait buffer filled after underrun.
+u64         frozen_at_ns      = 0;
+bool        realtime_memory   = false; // if true, memory is locked and the fill/output paths must not allocate.
+n_frames    block_frames      = PCMPACKET_PERIOD; // frames decoded and processed at once. "dsp_block_frames" of boxten configuration.
+void        buffer_underrun_handler() {
+    AllowAllocation allow; // already glitching. pausing the output is more important.
     DEBUG_OUT("buffer underrun!");
+    buffer_sizer.report_underrun();
     if(!get_if_playlist_left()) {
         stop_playback();
     } else if(!playback_frozen) {
         stream_output->pause_playback();
+        frozen_at_ns    = steady_time_ns();
         playback_frozen = true;
     }
 }
@@ -35,80 +65,188 @@ void   buffer_underrun_handler() {
 struct FilledFramePos {
     i64 song = -1;
     u64 frame;
+    u64 generation = 0; // incremented when the position jumps, or the playing song is erased.
 };
 SafeVar<FilledFramePos> filled_frame_pos;
+std::mutex              decode_lock; // held by the fill thread while decoding without filled_frame_pos.lock.
+// Songs which with_playing_song() probes without the playlist mutex. playing_playlist_erase() waits for them.
+SafeVar<std::vector<AudioFile*>> probing_files;
+std::condition_variable          probe_done;
 bool                    end_of_playlist           = false; // If true, all of playlist were sent to buffer already.
 bool                    finish_fill_buffer_thread = false;
-void                    fill_buffer() {
+enum class Unfreeze {
+    NONE,
+    START,
+    RESUME,
+};
+// Decides whether the output can be started or resumed. Called under filled_frame_pos.lock.
+// Pass the result to unfreeze() after unlocking it, so that the output plugin is not called under the lock.
+Unfreeze check_unfreeze() {
+    if(!playback_starting && !playback_frozen) return Unfreeze::NONE;
+    if(!buffer.has_enough_packets()) return Unfreeze::NONE;
+    if(playback_starting) {
+        playback_starting = false;
+        return Unfreeze::START;
+    }
+    buffer.record_freeze(steady_time_ns() - frozen_at_ns);
+    playback_frozen = false;
+    return Unfreeze::RESUME;
+}
+void unfreeze(Unfreeze action) {
+    if(action == Unfreeze::START) {
+        stream_output->start_playback();
+    } else if(action == Unfreeze::RESUME) {
+        stream_output->resume_playback();
+    }
+}
+// Cuts the frames of the packet which are out of the playable range, and moves its positions to the trimmed timeline.
+void trim_packet(PCMPacketUnit& packet, const GaplessInfo& gapless, n_frames playable) {
+    const size_t frame_bytes = packet.format.get_sample_bytewidth() * packet.format.channels;
+    if(frame_bytes == 0) return;
+    const u64 begin      = packet.original_frame_pos[0];
+    const u64 end        = begin + packet.get_frames();
+    const u64 keep_begin = std::max(begin, gapless.delay);
+    const u64 keep_end   = std::min(end, gapless.delay + playable);
+    if(keep_begin >= keep_end) {
+        packet.pcm.clear();
+        packet.original_frame_pos[0] = packet.original_frame_pos[1] = keep_end > gapless.delay ? keep_end - gapless.delay - 1 : 0;
+        return;
+    }
+    if(keep_end < end) packet.pcm.resize((keep_end - begin) * frame_bytes);
+    if(keep_begin > begin) packet.pcm.erase(packet.pcm.begin(), packet.pcm.begin() + (keep_begin - begin) * frame_bytes);
+    packet.original_frame_pos[0] = keep_begin - gapless.delay;
+    packet.original_frame_pos[1] = keep_end - gapless.delay - 1;
+}
+// Sink of the pipeline. Called by the fill thread, or by the last DSP thread in the pipelined mode.
+void deliver_packet(PCMPacketUnit&& packet, u64 generation) {
+    Unfreeze action;
+    {
+        std::lock_guard<std::mutex> lock(filled_frame_pos.lock);
+        if(generation != filled_frame_pos->generation) return; // seeked while processing.
+        buffer.append(std::move(packet));
+        // long bursts(e.g. deep buffer mode) should not delay the start of playback.
+        action = check_unfreeze();
+    }
+    unfreeze(action);
+}
+void fill_buffer() {
+    apply_thread_policy(AudioThread::FILL);
+    if(realtime_memory) prefault_stack(64 * 1024);
+    RealtimeSection realtime_section(realtime_memory);
+    u64             generation = 0; // of the position the crossfader worked on.
     while(1) {
-        if(playback_starting || playback_frozen) {
-            if(buffer.has_enough_packets()) {
-                if(playback_starting) {
-                    stream_output->start_playback();
-                    playback_starting = false;
-                } else if(playback_frozen) {
-                    stream_output->resume_playback();
-                    playback_frozen = false;
-                }
-            }
+        {
+            std::unique_lock<std::mutex> lock(filled_frame_pos.lock); // deliver_packet() may run on another thread.
+            const auto                   action = check_unfreeze();
+            lock.unlock();
+            unfreeze(action);
         }
 
-        std::unique_lock<std::mutex> lock(buffer.need_fill_buffer.lock);
-        buffer.continue_fill_buffer.wait(lock, [&] {
-            return buffer.need_fill_buffer || finish_fill_buffer_thread;
-        });
-        if(finish_fill_buffer_thread) break;
-        while(buffer.free_frame() >= PCMPACKET_PERIOD && !end_of_playlist) {
-            std::lock_guard<std::mutex> lock(filled_frame_pos.lock);
-            std::lock_guard<std::mutex> plock(playing_playlist->mutex());
-            if(filled_frame_pos->song >= static_cast<i64>(playing_playlist->size())) {
-                end_of_playlist = true;
-                continue;
-            }
-            auto&    audio_file  = *(*playing_playlist)[filled_frame_pos->song];
-            n_frames frames_left = audio_file.get_total_frames() - (filled_frame_pos->frame + 1);
-            n_frames to_read     = frames_left >= PCMPACKET_PERIOD ? PCMPACKET_PERIOD : frames_left;
-            auto     packet      = stream_input->read_frames(audio_file, filled_frame_pos->frame, to_read);
+        {
+            // Do not hold this lock while decoding, or StreamOutput would wait for the decoder in Buffer::cut().
+            std::unique_lock<std::mutex> lock(buffer.need_fill_buffer.lock);
+            buffer.continue_fill_buffer.wait(lock, [&] {
+                return buffer.need_fill_buffer || finish_fill_buffer_thread;
+            });
+            if(finish_fill_buffer_thread) break;
+            buffer.need_fill_buffer = false;
+        }
+        buffer.record_wakeup();
+        auto     burst_start  = thread_cpu_time_ns();
+        n_frames burst_frames = 0;
+        while(buffer.needs_refill() && !end_of_playlist) {
+            // Take a snapshot of the position, decode and process it without locks, and then commit the result.
+            // Seeks and playlist edits which happened meanwhile are detected by the generation.
+            FilledFramePos               snapshot;
+            AudioFile*                   audio_file;
+            AudioFile*                   next_file;
+            std::unique_lock<std::mutex> dlock(decode_lock, std::defer_lock); // keeps the songs alive until the packet is processed.
             {
-                std::lock_guard<std::mutex> lock(dsp_chain.lock);
-                for(auto c : dsp_chain.data) {
-                    c->modify_packet(packet);
-                }
-            }
-            filled_frame_pos->frame = packet.original_frame_pos[1] + 1;
-            if(filled_frame_pos->frame >= audio_file.get_total_frames()) {
-                if(filled_frame_pos->song + 1 == static_cast<i64>(playing_playlist->size())) {
+                // The playlist mutex is locked first, as Playlist::insert() and erase() do.
+                std::lock_guard<std::mutex> plock(playing_playlist->mutex());
+                std::lock_guard<std::mutex> lock(filled_frame_pos.lock);
+                if(filled_frame_pos->song >= static_cast<i64>(playing_playlist->size())) {
                     end_of_playlist = true;
                     continue;
-                } else {
-                    invoke_eventhook(Events::SONG_CHANGE, new HookParameters::SongChange{static_cast<i64>(filled_frame_pos->song), static_cast<i64>(filled_frame_pos->song + 1)});
-                    filled_frame_pos->song++;
-                    filled_frame_pos->frame = 0;
                 }
+                snapshot   = filled_frame_pos;
+                audio_file = (*playing_playlist)[snapshot.song];
+                next_file  = snapshot.song + 1 < static_cast<i64>(playing_playlist->size()) ? (*playing_playlist)[snapshot.song + 1] : nullptr;
+                dlock.lock();
+            }
+            // The first call probes the file under the input lock, which the prefetcher may hold. Do not keep the locks above meanwhile.
+            const n_frames playable = audio_file->get_playable_frames();
+            if(snapshot.generation != generation) {
+                crossfader.reset();
+                generation = snapshot.generation;
+            }
+
+            n_frames frames_left = playable - (snapshot.frame + 1);
+            n_frames to_read     = frames_left >= block_frames ? block_frames : frames_left;
+            auto     packet      = read_playable_frames(*audio_file, snapshot.frame, to_read);
+            prefetcher.update(next_file, frames_left, packet.format.sampling_rate);
+            crossfader.process(*audio_file, next_file, packet);
+            dlock.unlock();
+
+            PCMPacket faded_in; // frames of the next song, which were decoded for the crossfade but not mixed.
+            {
+                std::unique_lock<std::mutex> plock(playing_playlist->mutex(), std::defer_lock);
+                if(packet.original_frame_pos[1] + 1 >= playable) plock.lock(); // the song ends.
+                std::lock_guard<std::mutex> lock(filled_frame_pos.lock);
+                // The position was changed while decoding. Throw the packet away.
+                if(filled_frame_pos->generation != snapshot.generation) continue;
+                buffer_sizer.update(buffer, packet.format.sampling_rate);
+                filled_frame_pos->frame = packet.original_frame_pos[1] + 1;
+                if(filled_frame_pos->frame >= playable) {
+                    if(filled_frame_pos->song + 1 == static_cast<i64>(playing_playlist->size())) {
+                        // Deliver the last packet too, and let it flush the pipeline.
+                        end_of_playlist = true;
+                    } else {
+                        AllowAllocation allow; // once per song.
+                        invoke_eventhook(Events::SONG_CHANGE, new HookParameters::SongChange{static_cast<i64>(filled_frame_pos->song), static_cast<i64>(filled_frame_pos->song + 1)});
+                        // A song inserted after the playing one replaces the song which was faded in.
+                        if((*playing_playlist)[filled_frame_pos->song + 1] != next_file) crossfader.reset();
+                        filled_frame_pos->song++;
+                        filled_frame_pos->frame = crossfader.finish(faded_in);
+                    }
+                }
+            }
+            // The pipeline passes the packets to deliver_packet(). process() needs no lock, even while set_dsp_chain() swaps the chain.
+            burst_frames += packet.get_frames();
+            pipeline->process(std::move(packet), snapshot.generation, end_of_playlist);
+            for(auto& p : faded_in) {
+                burst_frames += p.get_frames();
+                pipeline->process(std::move(p), snapshot.generation);
             }
-            buffer.append(packet);
         }
-        buffer.need_fill_buffer = false;
+        buffer.record_burst(burst_frames);
+        buffer.record_refill_done();
+        buffer.record_fill_cpu_time(thread_cpu_time_ns() - burst_start);
     }
 }
 Worker fill_buffer_thread;
 
 struct PlayingPacket {
     struct PacketFormat {
-        u64 playing_frame_pos[2];
-        u32 sampling_rate;
+        u64      playing_frame_pos[2];
+        n_frames frames; // actual length. differs from playing_frame_pos if resampled.
+        u32      sampling_rate;
     };
     std::optional<u64>                    seeked_to; // if holds value, use this as a playing pos.
     std::vector<PacketFormat>             packet_formats;
     std::chrono::system_clock::time_point update_time;
-    void                                  refresh(const PCMPacket& packet) {
+    void                                  append(const u64 (&frame_pos)[2], n_frames frames, u32 sampling_rate) {
+        PlayingPacket::PacketFormat format;
+        format.playing_frame_pos[0] = frame_pos[0];
+        format.playing_frame_pos[1] = frame_pos[1];
+        format.frames               = frames;
+        format.sampling_rate        = sampling_rate;
+        packet_formats.emplace_back(format);
+    }
+    void refresh(PCMPacket& packet) {
         packet_formats.clear();
         for(auto& p : packet) {
-            PlayingPacket::PacketFormat format;
-            format.playing_frame_pos[0] = p.original_frame_pos[0];
-            format.playing_frame_pos[1] = p.original_frame_pos[1];
-            format.sampling_rate        = p.format.sampling_rate;
-            packet_formats.emplace_back(format);
+            append(p.original_frame_pos, p.get_frames(), p.format.sampling_rate);
         }
         update_time = std::chrono::system_clock::now();
     };
@@ -128,6 +266,82 @@ enum COMMAND {
     CHANGE_SONG_ABS,
     CHANGE_SONG_REL,
 };
+void apply_memory_config() {
+    nlohmann::json config_data;
+    config::load_configuration(config_data);
+    realtime_memory = config_data.is_object() && config_data.value("realtime_memory", false);
+    profiling       = !config_data.is_object() || config_data.value("dsp_profile", true);
+    // Larger blocks save per-packet overhead of the DSP chain, at the cost of latency and larger pool blocks.
+    block_frames = PCMPACKET_PERIOD;
+    if(config_data.is_object() && type_check("dsp_block_frames", JSON_TYPE::NUMBER, config_data)) {
+        block_frames = std::clamp<n_frames>(config_data["dsp_block_frames"].get<n_frames>(), PCMPACKET_PERIOD, PCMPACKET_PERIOD * 16);
+    }
+    if(realtime_memory && block_frames != PCMPACKET_PERIOD) {
+        // The pool classes and the resamplers are sized for packets of PCMPACKET_PERIOD frames. Larger blocks would allocate on the audio path.
+        console.warning << "\"dsp_block_frames\" is ignored while \"realtime_memory\" is enabled." << std::endl;
+        block_frames = PCMPACKET_PERIOD;
+    }
+    // Reserve blocks of the size class which buffered packets use.
+    size_t packet_bytes;
+    {
+        std::lock_guard<std::mutex> lock(pipeline.lock);
+        packet_bytes = block_frames * pipeline->max_output_frame_bytes();
+    }
+    if(!realtime_memory) {
+        unlock_memory();
+        // The pool grows by itself while the buffer is filled first time. Reserve some blocks to get started.
+        reserve_pcm_pool(std::min<size_t>(buffer.slot_capacity(), 128) + 16, packet_bytes);
+        return;
+    }
+    // Reserve blocks for the whole buffer, so that the fill thread never grows the pool.
+    // Deep buffers would pin hundreds of megabytes this way. Beyond the limit, the pool grows while the buffer is filled.
+    size_t packets = buffer_sizer.max_frames() / block_frames + 64;
+    if(packets * packet_bytes > max_reserved_pool_bytes) {
+        packets = max_reserved_pool_bytes / packet_bytes;
+        console.warning << "the buffer is larger than the reserved memory pool. the fill thread may allocate memory." << std::endl;
+    }
+    reserve_pcm_pool(packets, packet_bytes);
+    prefault_pcm_pool();
+    {
+        std::lock_guard<std::mutex> lock(playing_packet.lock);
+        playing_packet->packet_formats.reserve(256);
+    }
+    if(!lock_memory()) {
+        console.warning << "failed to lock memory. check RLIMIT_MEMLOCK." << std::endl;
+    }
+}
+// Drops buffered audio on seeks.
+// filled_frame_pos.lock must be locked, so that packets of the new position are not delivered before this.
+// The crossfader and the pipeline drop the state for the old position by themselves, when they find the generation changed.
+void discard_buffer() {
+    filled_frame_pos->generation++;
+    buffer.clear();
+}
+// Calls 'body' with the playing song and its playable frames, under the playlist mutex and filled_frame_pos.lock.
+// Probing a song waits for the input lock, which a decode holds. A song which is not probed yet is therefore probed
+// without those locks first, and the playing song is looked up again afterwards.
+template <typename Body>
+void with_playing_song(Body body) {
+    while(true) {
+        AudioFile* file;
+        {
+            std::lock_guard<std::mutex> pllock(playing_playlist->mutex());
+            std::lock_guard<std::mutex> fflock(filled_frame_pos.lock);
+            if(filled_frame_pos->song < 0 || filled_frame_pos->song >= static_cast<i64>(playing_playlist->size())) return;
+            file = (*playing_playlist)[filled_frame_pos->song];
+            if(file->is_probed()) {
+                body(*file, file->get_playable_frames());
+                return;
+            }
+            std::lock_guard<std::mutex> lock(probing_files.lock);
+            probing_files->emplace_back(file);
+        }
+        file->get_playable_frames();
+        std::lock_guard<std::mutex> lock(probing_files.lock);
+        probing_files->erase(std::find(probing_files->begin(), probing_files->end(), file));
+        probe_done.notify_all();
+    }
+}
 void proc_resume_playback();
 i64  proc_get_playing_index() {
     if(playback_state == PlaybackState::STOPPED) return -1;
@@ -146,7 +360,7 @@ i64 proc_get_playback_pos() {
     for(auto& p : playing_packet->packet_formats) {
         auto     elapsed     = std::chrono::duration_cast<std::chrono::milliseconds>(now - playing_packet->update_time).count();
         n_frames dur         = p.playing_frame_pos[1] - p.playing_frame_pos[0];
-        u64      miliseconds = 1000.0 * dur / p.sampling_rate;
+        u64      miliseconds = 1000.0 * p.frames / p.sampling_rate;
         if(static_cast<u64>(elapsed) > miliseconds) {
             continue;
         }
@@ -174,12 +388,35 @@ void proc_start_playback() {
     invoke_eventhook(Events::SONG_CHANGE, new HookParameters::SongChange{filled_frame_pos->song, 0});
     filled_frame_pos->song  = 0;
     filled_frame_pos->frame = 0;
+    filled_frame_pos->generation++;
 
     end_of_playlist = false;
+    crossfader.load();
+    prefetcher.load();
     buffer.set_buffer_underrun_handler(buffer_underrun_handler);
+    buffer_sizer.load(stream_output->component_name);
+    buffer.resize(buffer_sizer.max_frames());
+    buffer_sizer.update(buffer, 44100); // corrected by the first packet.
+    buffer.reset_statistics();
+    decoder_profile.reset();
+    {
+        std::lock_guard<std::mutex> lock(pipeline.lock);
+        pipeline->load();
+        pipeline->set_output(*stream_output);
+        pipeline->set_sink(deliver_packet);
+    }
+    apply_memory_config();
+    load_thread_policies();
+    calibrate_cycles();
+    {
+        std::lock_guard<std::mutex> lock(pipeline.lock);
+        pipeline->start(realtime_memory);
+    }
+    apply_thread_policy(AudioThread::PLAYBACK); // proc_*() run on the playback thread.
 
     finish_fill_buffer_thread = false;
     fill_buffer_thread        = Worker(fill_buffer);
+    prefetcher.start();
 
     playback_starting = true;
     invoke_eventhook(Events::PLAYBACK_CHANGE, new HookParameters::PlaybackChange{playback_state, PlaybackState::PLAYING});
@@ -191,6 +428,11 @@ void proc_stop_playback() {
     finish_fill_buffer_thread = true;
     buffer.continue_fill_buffer.notify_one();
     fill_buffer_thread.join();
+    prefetcher.finish();
+    {
+        std::lock_guard<std::mutex> lock(pipeline.lock);
+        pipeline->stop();
+    }
 
     stream_output->stop_playback();
     invoke_eventhook(Events::PLAYBACK_CHANGE, new HookParameters::PlaybackChange{playback_state, PlaybackState::STOPPED});
@@ -220,30 +462,22 @@ void proc_resume_playback() {
 void proc_seek_rate_abs(f64 rate) {
     if(rate < 0.0) return;
     if(rate > 1.0) return;
-    {
-        std::lock_guard<std::mutex> fflock(filled_frame_pos.lock);
-        std::lock_guard<std::mutex> pllock(playing_playlist->mutex());
-
-        if(filled_frame_pos->song < 0 || filled_frame_pos->song >= static_cast<i64>(playing_playlist->size())) return;
-        auto& audio_file        = *(*playing_playlist)[filled_frame_pos->song];
-        filled_frame_pos->frame = audio_file.get_total_frames() * rate;
+    with_playing_song([&](AudioFile&, n_frames playable) {
+        filled_frame_pos->frame = playable * rate;
 
-        std::lock_guard<std::mutex> pplock(playing_packet.lock);
-        playing_packet->seeked_to = filled_frame_pos->frame;
-    }
-    buffer.clear();
+        {
+            std::lock_guard<std::mutex> pplock(playing_packet.lock);
+            playing_packet->seeked_to = filled_frame_pos->frame;
+        }
+        discard_buffer();
+    });
 }
 void proc_seek_rate_rel(f64 rate) {
     if(rate < -1.0) return;
     if(rate > 1.0) return;
-    {
-        std::lock_guard<std::mutex> fflock(filled_frame_pos.lock);
-        std::lock_guard<std::mutex> pllock(playing_playlist->mutex());
-
-        if(filled_frame_pos->song < 0 || filled_frame_pos->song >= static_cast<i64>(playing_playlist->size())) return;
-        auto& audio_file = *(*playing_playlist)[filled_frame_pos->song];
+    with_playing_song([&](AudioFile&, n_frames playable) {
         filled_frame_pos->frame *= rate;
-        if(filled_frame_pos->frame + 1 >= audio_file.get_total_frames()) {
+        if(filled_frame_pos->frame + 1 >= playable) {
             if(filled_frame_pos->song == static_cast<i64>(playing_playlist->size())) {
                 end_of_playlist = true;
             } else {
@@ -251,10 +485,12 @@ void proc_seek_rate_rel(f64 rate) {
                 filled_frame_pos->frame = 0;
             }
         }
-        std::lock_guard<std::mutex> pplock(playing_packet.lock);
-        playing_packet->seeked_to = filled_frame_pos->frame;
-    }
-    buffer.clear();
+        {
+            std::lock_guard<std::mutex> pplock(playing_packet.lock);
+            playing_packet->seeked_to = filled_frame_pos->frame;
+        }
+        discard_buffer();
+    });
 }
 void proc_change_song_abs(i64 index) {
     if(index < 0) return;
@@ -266,26 +502,30 @@ void proc_change_song_abs(i64 index) {
         filled_frame_pos->song  = index;
         filled_frame_pos->frame = 0;
 
-        std::lock_guard<std::mutex> pplock(playing_packet.lock);
-        playing_packet->seeked_to = filled_frame_pos->frame;
+        {
+            std::lock_guard<std::mutex> pplock(playing_packet.lock);
+            playing_packet->seeked_to = filled_frame_pos->frame;
+        }
+        discard_buffer();
     }
-    buffer.clear();
 }
 void proc_change_song_rel(i64 val) {
     if(val == 0) return;
     {
-        std::lock_guard<std::mutex> fflock(filled_frame_pos.lock);
         std::lock_guard<std::mutex> pllock(playing_playlist->mutex());
+        std::lock_guard<std::mutex> fflock(filled_frame_pos.lock);
         if(filled_frame_pos->song + val < 0) return;
         if(filled_frame_pos->song + val >= static_cast<i64>(playing_playlist->size())) return;
         invoke_eventhook(Events::SONG_CHANGE, new HookParameters::SongChange{filled_frame_pos->song, filled_frame_pos->song + val});
         filled_frame_pos->song += val;
         filled_frame_pos->frame = 0;
 
-        std::lock_guard<std::mutex> pplock(playing_packet.lock);
-        playing_packet->seeked_to = filled_frame_pos->frame;
+        {
+            std::lock_guard<std::mutex> pplock(playing_packet.lock);
+            playing_packet->seeked_to = filled_frame_pos->frame;
+        }
+        discard_buffer();
     }
-    buffer.clear();
 }
 
 struct PlaybackControl {
@@ -377,16 +617,28 @@ PlaybackState get_playback_state() {
 }
 n_frames get_playing_song_length() {
     std::lock_guard<std::mutex> lock(playback_thread.wait_empty());
-    std::lock_guard<std::mutex> fflock(filled_frame_pos.lock);
-    std::lock_guard<std::mutex> pllock(playing_playlist->mutex());
-
-    if(filled_frame_pos->song < 0 || filled_frame_pos->song >= static_cast<i64>(playing_playlist->size())) return 0;
-    auto& audio_file = *(*playing_playlist)[filled_frame_pos->song];
-    return audio_file.get_total_frames();
+    n_frames                    length = 0;
+    with_playing_song([&](AudioFile&, n_frames playable) { length = playable; });
+    return length;
 }
 bool get_if_playlist_left() {
     return !end_of_playlist;
 }
+BufferStatistics get_buffer_statistics() {
+    return buffer.get_statistics();
+}
+std::vector<DSPThreadStatistics> get_dsp_thread_statistics() {
+    std::lock_guard<std::mutex> lock(pipeline.lock);
+    return pipeline->get_statistics();
+}
+
+std::vector<ProcessorStatistics> get_processor_statistics() {
+    std::lock_guard<std::mutex> lock(pipeline.lock);
+    return pipeline->get_processor_statistics();
+}
+ProfileStatistics get_decoder_statistics() {
+    return decoder_profile.get();
+}
 
 /* internal */
 void set_stream_input(StreamInput* input) {
@@ -396,8 +648,8 @@ void set_stream_output(StreamOutput* output) {
     stream_output = output;
 }
 void set_dsp_chain(std::vector<SoundProcessor*> dsp) {
-    std::lock_guard<std::mutex> lock(dsp_chain.lock);
-    dsp_chain.data = dsp;
+    std::lock_guard<std::mutex> lock(pipeline.lock);
+    pipeline->set_processors(dsp);
 }
 void start_playback_thread() {
     playback_thread.start();
@@ -430,7 +682,17 @@ void playing_playlist_insert(u64 pos, AudioFile* audio_file) {
 void playing_playlist_erase(u64 pos) {
     // playing_playlist->mutex() must be locked
     // Because this function only be called from Playlist::erase()
+    prefetcher.forget((*playing_playlist)[pos]);
+    {
+        std::unique_lock<std::mutex> lock(probing_files.lock);
+        probe_done.wait(lock, [&] { return std::find(probing_files->begin(), probing_files->end(), (*playing_playlist)[pos]) == probing_files->end(); });
+    }
     std::lock_guard<std::mutex> lock(filled_frame_pos.lock);
+    if(static_cast<i64>(pos) == filled_frame_pos->song || static_cast<i64>(pos) == filled_frame_pos->song + 1) {
+        // The fill thread may be decoding the song, or fading it in. Wait for it before the song is freed.
+        std::lock_guard<std::mutex> dlock(decode_lock);
+        crossfader.reset();
+    }
 
     if(static_cast<i64>(pos) > filled_frame_pos->song) {
         /* The music is after playing music. Nothing to do. */
@@ -438,6 +700,7 @@ void playing_playlist_erase(u64 pos) {
         filled_frame_pos->song--;
     } else { // pos == playing_music_num
         filled_frame_pos->frame = 0;
+        filled_frame_pos->generation++;
     }
     if(playing_playlist->empty()) stop_playback();
     return;
@@ -447,7 +710,10 @@ n_frames get_buffer_filled_frames() {
     return buffer.filled_frame();
 }
 PCMPacket get_buffer_pcm_packet(n_frames frames) {
-    auto packet = buffer.cut(frames);
+    // result vector is allocated here. outputs which care should use render_buffer_pcm().
+    apply_thread_policy_once(AudioThread::OUTPUT);
+    RealtimeSection realtime_section(realtime_memory);
+    auto            packet = buffer.cut(frames);
     if(!packet.empty()) {
         std::lock_guard<std::mutex> lock(playing_packet.lock);
         playing_packet->refresh(packet);
@@ -458,6 +724,42 @@ PCMPacket get_buffer_pcm_packet(n_frames frames) {
 PCMFormat get_buffer_pcm_format() {
     return buffer.get_next_format();
 }
+n_frames render_buffer_pcm(u8* destination, n_frames frames, const PCMFormat& format) {
+    apply_thread_policy_once(AudioThread::OUTPUT);
+    RealtimeSection realtime_section(realtime_memory);
+    const size_t    frame_bytes = format.channels * get_sample_bytewidth(format.sample_type);
+
+    // Positions are collected here and published at once, so that get_playback_pos() does not wait for the conversion.
+    PlayingPacket::PacketFormat formats[64];
+    size_t                      count   = 0;
+    bool                        first   = true;
+    const auto                  publish = [&](bool last) {
+        std::lock_guard<std::mutex> lock(playing_packet.lock);
+        if(first) {
+            playing_packet->packet_formats.clear();
+            first = false;
+        }
+        for(size_t i = 0; i < count; ++i) {
+            playing_packet->packet_formats.emplace_back(formats[i]);
+        }
+        count = 0;
+        if(last) {
+            playing_packet->update_time = std::chrono::system_clock::now();
+            playing_packet->seeked_to.reset();
+        }
+    };
+    auto done = buffer.read(frames, [&](const PCMView& view) -> n_frames {
+        if(view.format.channels != format.channels || view.format.sampling_rate != format.sampling_rate) return 0;
+        convert_samples(view.pcm, view.format.sample_type, destination, format.sample_type, view.frames * format.channels);
+        destination += view.frames * frame_bytes;
+        if(count == std::size(formats)) publish(false);
+        formats[count] = {{view.original_frame_pos[0], view.original_frame_pos[1]}, view.frames, view.format.sampling_rate};
+        count += 1;
+        return view.frames;
+    });
+    if(done != 0) publish(true);
+    return done;
+}
 
 n_frames get_total_frames(AudioFile* audio_file) {
     return stream_input->calc_total_frames(*audio_file);
@@ -465,4 +767,30 @@ n_frames get_total_frames(AudioFile* audio_file) {
 AudioTag get_tags(AudioFile* audio_file) {
     return stream_input->read_tags(*audio_file);
 }
+PCMPacketUnit read_playable_frames(AudioFile& audio_file, n_frames from, n_frames frames) {
+    if(PCMPacketUnit packet; prefetcher.take(audio_file, from, packet)) return packet;
+    auto decode_start = steady_time_ns();
+    auto packet       = decode_playable_frames(audio_file, from, frames);
+    buffer.record_decode_time(steady_time_ns() - decode_start);
+    return packet;
+}
+PCMPacketUnit decode_playable_frames(AudioFile& audio_file, n_frames from, n_frames frames) {
+    std::lock_guard<std::recursive_mutex> lock(input_lock);
+    auto                                  gapless   = audio_file.get_gapless_info();
+    const auto                            cpu_begin = profiling ? thread_cpu_time_ns() : 0;
+    const auto                            begin     = read_cycles();
+    auto                                  packet    = stream_input->read_frames(audio_file, gapless.delay + from, frames);
+    if(profiling) {
+        const auto end = read_cycles();
+        decoder_profile.record(cycles_to_ns(end - begin), thread_cpu_time_ns() - cpu_begin, packet_duration_ns(packet), 0, 0);
+    }
+    trim_packet(packet, gapless, audio_file.get_playable_frames());
+    return packet;
+}
+std::recursive_mutex& get_input_lock() {
+    return input_lock;
+}
+GaplessInfo get_gapless_info(AudioFile* audio_file) {
+    return stream_input->read_gapless_info(*audio_file);
+}
 } // namespace boxten
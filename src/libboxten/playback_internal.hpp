@@ -1,4 +1,6 @@
 /* This is an internal header, which will not be installed. */
+#include <mutex>
+
 #include "playlist.hpp"
 #include "plugin.hpp"
 #include "queuethread.hpp"
@@ -7,6 +9,8 @@ namespace boxten {
 /* boxten */
 void set_stream_input(StreamInput* input);
 void set_stream_output(StreamOutput* output);
+// Can be called during playback. Processors taken out of the chain may be used until the packets in flight are done,
+// so close them after stop_playback().
 void set_dsp_chain(std::vector<SoundProcessor*> dsp_chain);
 void start_playback_thread();
 void finish_playback_thread();
@@ -22,8 +26,20 @@ void playing_playlist_erase(u64 pos);
 n_frames  get_buffer_filled_frames();
 PCMPacket get_buffer_pcm_packet(n_frames frames);
 PCMFormat get_buffer_pcm_format();
+n_frames  render_buffer_pcm(u8* destination, n_frames frames, const PCMFormat& format);
+
+/* Crossfader, Prefetcher */
+// Reads frames on the timeline of playable frames, where encoder delay and padding are trimmed.
+// Prefetched packets are used if any.
+PCMPacketUnit read_playable_frames(AudioFile& audio_file, n_frames from, n_frames frames);
+// Same as read_playable_frames(), but always decodes.
+PCMPacketUnit decode_playable_frames(AudioFile& audio_file, n_frames from, n_frames frames);
 
 /* AudioFile */
-n_frames get_total_frames(AudioFile* audio_file);
-AudioTag get_tags(AudioFile* audio_file);
+// Serializes StreamInput calls, which are shared by the fill thread and the prefetcher, and the first probe of each metadata
+// cached in AudioFile. Cached metadata is read without this lock.
+std::recursive_mutex& get_input_lock();
+n_frames    get_total_frames(AudioFile* audio_file);
+AudioTag    get_tags(AudioFile* audio_file);
+GaplessInfo get_gapless_info(AudioFile* audio_file);
 } // namespace boxten
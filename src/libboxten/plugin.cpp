@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "plugin.hpp"
 #include "config.h"
 #include "configuration.hpp"
@@ -61,13 +63,65 @@ Component::~Component() {
     DEBUG_OUT("component \"" << component_name[1] << "\" closed.");
 }
 
+GaplessInfo StreamInput::read_gapless_info(AudioFile&) {
+    return GaplessInfo();
+}
 StreamInput::~StreamInput() {
     cleanup_private_data(this);
 }
 
+FormatCapabilities SoundProcessor::get_capabilities() {
+    return FormatCapabilities();
+}
+bool SoundProcessor::is_in_place() {
+    return false;
+}
+bool SoundProcessor::modify_block(PCMBlock& block) {
+    if(block.packet != nullptr && block.frames <= PCMPACKET_PERIOD) return modify_packet(*block.packet);
+
+    // Pass copies of each PCMPACKET_PERIOD frames. In-place processors give them back in the same format and length.
+    const size_t sample_bytes = block.format.get_sample_bytewidth();
+    const size_t frame_bytes  = sample_bytes * block.format.channels;
+    const u64    positions    = block.original_frame_pos[1] - block.original_frame_pos[0] + 1;
+    auto         copy         = [&](u8* block_pcm, u8* packet_pcm, n_frames offset, n_frames frames, bool to_packet) {
+        if(!block.format.planar) {
+            to_packet ? std::memcpy(packet_pcm, block_pcm + offset * frame_bytes, frames * frame_bytes)
+                      : std::memcpy(block_pcm + offset * frame_bytes, packet_pcm, frames * frame_bytes);
+            return;
+        }
+        for(u32 c = 0; c < block.format.channels; ++c) {
+            auto b = block_pcm + (c * block.frames + offset) * sample_bytes;
+            auto p = packet_pcm + c * frames * sample_bytes;
+            to_packet ? std::memcpy(p, b, frames * sample_bytes) : std::memcpy(b, p, frames * sample_bytes);
+        }
+    };
+    PCMPacketUnit packet;
+    bool          result = true;
+    for(n_frames done = 0; done < block.frames;) {
+        const auto frames = std::min(PCMPACKET_PERIOD, block.frames - done);
+        packet.format     = block.format;
+        // Positions may be scaled from the frames if the block was resampled.
+        packet.original_frame_pos[0] = block.original_frame_pos[0] + positions * done / block.frames;
+        packet.original_frame_pos[1] = block.original_frame_pos[0] + positions * (done + frames) / block.frames - 1;
+        packet.pcm.resize(frames * frame_bytes);
+        copy(block.pcm, packet.pcm.data(), done, frames, true);
+        result &= modify_packet(packet);
+        if(packet.format != block.format || packet.pcm.size() != frames * frame_bytes) {
+            DEBUG_OUT("\"" << component_name[1] << "\" is not in-place.");
+            return false;
+        }
+        copy(block.pcm, packet.pcm.data(), done, frames, false);
+        done += frames;
+    }
+    return result;
+}
+
 n_frames StreamOutput::output_delay() {
     return 0;
 }
+FormatCapabilities StreamOutput::get_supported_formats() {
+    return FormatCapabilities();
+}
 n_frames StreamOutput::get_buffer_filled_frames() {
     return boxten::get_buffer_filled_frames();
 }
@@ -77,4 +131,7 @@ PCMPacket StreamOutput::get_buffer_pcm_packet(n_frames frame) {
 PCMFormat StreamOutput::get_buffer_pcm_format() {
     return boxten::get_buffer_pcm_format();
 }
+n_frames StreamOutput::render_buffer_pcm(u8* destination, n_frames frames, const PCMFormat& format) {
+    return boxten::render_buffer_pcm(destination, frames, format);
+}
 } // namespace boxten
@@ -53,6 +53,17 @@ class SoundProcessor : public Component {
 
   public:
     virtual bool modify_packet(PCMPacketUnit& packet) = 0;
+    // Packets are converted to one of these formats before modify_packet(). Read once when the chain is set.
+    virtual FormatCapabilities get_capabilities();
+    // Return true if modify_packet() never changes the format of packets.
+    // It lets the engine choose a format which the following processors accept too.
+    virtual bool is_in_place();
+    // Batch entry point. In-place processors get whole blocks of frames here instead of modify_packet().
+    // The size of blocks is "dsp_block_frames" of boxten configuration, or PCMPACKET_PERIOD while "realtime_memory" is enabled.
+    // PCMBlock::discontinuous is set on the first block after the stream jumped, e.g. by a seek, a change of song by the user or the start of playback.
+    // Blocks which follow each other, including the ones across gapless or crossfaded song boundaries, do not have it.
+    // The default implementation calls modify_packet() for every PCMPACKET_PERIOD frames.
+    virtual bool modify_block(PCMBlock& block);
     SoundProcessor(void* param) : Component(param) {}
     virtual ~SoundProcessor() {}
 };
@@ -68,6 +79,8 @@ class StreamInput : public Component {
     virtual PCMPacketUnit read_frames(AudioFile& file, u64 from, n_frames frames) = 0;
     virtual n_frames      calc_total_frames(AudioFile& file)                      = 0;
     virtual AudioTag      read_tags(AudioFile& file)                              = 0;
+    // Encoder delay and padding of the file, in frames. read_frames() and calc_total_frames() still include them.
+    virtual GaplessInfo read_gapless_info(AudioFile& file);
     StreamInput(void* param) : Component(param) {}
     virtual ~StreamInput();
 };
@@ -77,9 +90,15 @@ class StreamOutput : public Component {
     static n_frames  get_buffer_filled_frames();
     static PCMPacket get_buffer_pcm_packet(n_frames frames);
     static PCMFormat get_buffer_pcm_format();
+    // Writes up to 'frames' interleaved frames into destination, converting them to format.sample_type.
+    // Stops before frames whose channels or sampling rate differ from format.
+    // Returns the number of written frames.
+    static n_frames  render_buffer_pcm(u8* destination, n_frames frames, const PCMFormat& format);
 
   public:
     virtual n_frames output_delay(); // delay between get_buffer_pcm_packet() and speaker sounds.
+    // Packets are converted to one of these formats before they are stored in the buffer. Read on every start_playback().
+    virtual FormatCapabilities get_supported_formats();
     virtual void     start_playback()  = 0;
     virtual void     stop_playback()   = 0;
     virtual void     pause_playback()  = 0;
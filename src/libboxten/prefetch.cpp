@@ -0,0 +1,107 @@
+#include "prefetch.hpp"
+#include "configuration.hpp"
+#include "debug.hpp"
+#include "jsontest.hpp"
+#include "playback_internal.hpp"
+
+namespace boxten {
+void Prefetcher::loop() {
+    while(true) {
+        AudioFile* file;
+        {
+            std::unique_lock<std::mutex> l(lock);
+            requested.wait(l, [&]() { return target != nullptr || finish_thread; });
+            if(finish_thread) break;
+            file       = target;
+            target     = nullptr;
+            working    = file;
+            ready_file = file;
+            ready.clear();
+            ready_head = 0;
+        }
+        prefetch(*file);
+        {
+            std::lock_guard<std::mutex> l(lock);
+            working = nullptr;
+            cancel  = false;
+            idle.notify_all();
+        }
+    }
+}
+void Prefetcher::prefetch(AudioFile& file) {
+    // The first call of these opens the file and sets up the decoder. The results are cached, and later calls take no lock.
+    const auto playable = file.get_playable_frames();
+    file.get_tags();
+
+    n_frames frame = 0;
+    for(u32 i = 0; i < packets && frame < playable; ++i) {
+        if(std::lock_guard<std::mutex> l(lock); cancel || finish_thread) return;
+        // Decoded packet by packet, so that the fill thread waits for at most one packet for the input lock.
+        auto packet = decode_playable_frames(file, frame, std::min(PCMPACKET_PERIOD, playable - frame));
+        if(packet.get_frames() == 0) return;
+        frame = packet.original_frame_pos[1] + 1;
+
+        std::lock_guard<std::mutex> l(lock);
+        if(cancel || finish_thread) return;
+        ready.emplace_back(std::move(packet));
+    }
+    DEBUG_OUT("prefetched " << frame << " frames of " << file.get_path());
+}
+void Prefetcher::load() {
+    enabled   = true;
+    before_ms = 10000;
+    packets   = 4;
+    if(nlohmann::json config_data; config::load_configuration(config_data) && type_check("prefetch", JSON_TYPE::OBJECT, config_data)) {
+        auto& section = config_data["prefetch"];
+        if(section.contains("enabled") && section["enabled"].is_boolean()) enabled = section["enabled"].get<bool>();
+        if(type_check("before_ms", JSON_TYPE::NUMBER, section)) before_ms = section["before_ms"].get<u64>();
+        if(type_check("packets", JSON_TYPE::NUMBER, section)) packets = section["packets"].get<u32>();
+    }
+    ready.reserve(packets);
+}
+void Prefetcher::start() {
+    finish_thread = false;
+    thread        = Worker(std::bind(&Prefetcher::loop, this));
+}
+void Prefetcher::finish() {
+    {
+        std::lock_guard<std::mutex> l(lock);
+        finish_thread = true;
+        requested.notify_one();
+    }
+    thread.join();
+    target     = nullptr;
+    ready_file = nullptr;
+    ready.clear();
+    ready_head = 0;
+}
+void Prefetcher::update(AudioFile* next, n_frames frames_left, u32 sampling_rate) {
+    if(!enabled || next == nullptr || frames_left * 1000 > before_ms * sampling_rate) return;
+    std::lock_guard<std::mutex> l(lock);
+    // The next song can change by playlist edits. Requests for another song replace the old one.
+    if(next == ready_file || next == target) return;
+    target = next;
+    if(working != nullptr) cancel = true;
+    requested.notify_one();
+}
+void Prefetcher::forget(AudioFile* file) {
+    std::unique_lock<std::mutex> l(lock);
+    if(target == file) target = nullptr;
+    if(working == file) {
+        cancel = true;
+        idle.wait(l, [&]() { return working != file; });
+    }
+    if(ready_file == file) {
+        ready_file = nullptr;
+        ready.clear();
+        ready_head = 0;
+    }
+}
+bool Prefetcher::take(AudioFile& file, n_frames from, PCMPacketUnit& packet) {
+    std::lock_guard<std::mutex> l(lock);
+    if(ready_file != &file || ready_head == ready.size() || ready[ready_head].original_frame_pos[0] != from) return false;
+    packet = std::move(ready[ready_head]);
+    ready_head += 1;
+    return true;
+}
+} // namespace boxten
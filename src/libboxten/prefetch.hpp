@@ -0,0 +1,51 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "audiofile.hpp"
+#include "type.hpp"
+#include "worker.hpp"
+
+namespace boxten {
+// Opens, probes and decodes the first packets of the next song on its own thread,
+// so that the fill thread does not wait for storage at song changes.
+// Configured by "prefetch" section of boxten configuration:
+//   "before_ms" starts prefetching when the playing song has this much left. default 10000.
+//   "packets"   number of packets to decode ahead. 0 only opens and probes the song. default 4.
+//   "enabled"   default true.
+class Prefetcher {
+  private:
+    bool enabled   = true;
+    u64  before_ms = 10000;
+    u32  packets   = 4;
+
+    std::mutex                 lock;
+    std::condition_variable    requested;
+    std::condition_variable    idle;
+    AudioFile*                 target  = nullptr; // requested, but not yet picked up by the thread.
+    AudioFile*                 working = nullptr; // being decoded by the thread.
+    bool                       cancel  = false;
+    bool                       finish_thread;
+    AudioFile*                 ready_file = nullptr;
+    std::vector<PCMPacketUnit> ready; // decoded packets of ready_file, from the head of the song.
+    size_t                     ready_head = 0;
+    Worker                     thread;
+
+    void loop();
+    void prefetch(AudioFile& file);
+
+  public:
+    void load();
+    void start();
+    void finish();
+    // Called by the fill thread for every packet. Requests 'next' once the playing song has less than before_ms left.
+    void update(AudioFile* next, n_frames frames_left, u32 sampling_rate);
+    // Drops everything about the song, and waits for the thread to stop using it.
+    // The song must not be freed before this returns.
+    void forget(AudioFile* file);
+    // Moves the prefetched packet which starts at 'from' to 'packet', if any.
+    bool take(AudioFile& file, n_frames from, PCMPacketUnit& packet);
+};
+} // namespace boxten
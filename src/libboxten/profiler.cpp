@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <thread>
+
+#include "profiler.hpp"
+
+namespace boxten {
+namespace {
+std::atomic<f64>  ns_per_cycle = 1.0;
+std::atomic<bool> calibrated   = false;
+
+size_t histogram_bin(u64 ns) {
+    ns = std::min<u64>(ns, (1ull << 32) - 1);
+    if(ns < 8) return ns;
+    const u64 exponent = 63 - __builtin_clzll(ns);
+    return (exponent - 2) * 8 + ((ns >> (exponent - 3)) & 7);
+}
+u64 histogram_lower_bound(size_t bin) {
+    if(bin < 8) return bin;
+    return (8 + bin % 8) << (bin / 8 - 1);
+}
+} // namespace
+
+void calibrate_cycles() {
+    if(calibrated) return;
+    const auto time_begin   = steady_time_ns();
+    const auto cycles_begin = read_cycles();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const auto time_end   = steady_time_ns();
+    const auto cycles_end = read_cycles();
+    if(cycles_end > cycles_begin) ns_per_cycle = static_cast<f64>(time_end - time_begin) / (cycles_end - cycles_begin);
+    calibrated = true;
+}
+u64 cycles_to_ns(u64 cycles) {
+    return cycles * ns_per_cycle.load(std::memory_order_relaxed);
+}
+
+bool Profile::record(u64 wall, u64 cpu, u64 audio, f64 budget, u64 now) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    wall_ns.fetch_add(wall, std::memory_order_relaxed);
+    cpu_ns.fetch_add(cpu, std::memory_order_relaxed);
+    audio_ns.fetch_add(audio, std::memory_order_relaxed);
+    histogram[histogram_bin(wall)].fetch_add(1, std::memory_order_relaxed);
+    if(wall > max_ns.load(std::memory_order_relaxed)) max_ns.store(wall, std::memory_order_relaxed);
+    if(audio == 0) return false;
+    const auto factor = static_cast<f64>(wall) / audio;
+    if(factor > peak_factor.load(std::memory_order_relaxed)) peak_factor.store(factor, std::memory_order_relaxed);
+    if(budget <= 0 || factor <= budget) return false;
+    over_budget.fetch_add(1, std::memory_order_relaxed);
+    auto last = last_warned_ns.load(std::memory_order_relaxed);
+    if(last != 0 && now - last < 5000000000ull) return false;
+    return last_warned_ns.compare_exchange_strong(last, now, std::memory_order_relaxed);
+}
+void Profile::reset() {
+    calls          = 0;
+    over_budget    = 0;
+    wall_ns        = 0;
+    cpu_ns         = 0;
+    audio_ns       = 0;
+    max_ns         = 0;
+    peak_factor    = 0;
+    last_warned_ns = 0;
+    for(auto& h : histogram) {
+        h = 0;
+    }
+}
+ProfileStatistics Profile::get() const {
+    ProfileStatistics result;
+    result.calls                = calls;
+    result.over_budget          = over_budget;
+    result.wall_ns              = wall_ns;
+    result.cpu_ns               = cpu_ns;
+    result.audio_ns             = audio_ns;
+    result.max_ns               = max_ns;
+    result.realtime_factor      = result.audio_ns == 0 ? 0 : static_cast<f64>(result.wall_ns) / result.audio_ns;
+    result.peak_realtime_factor = peak_factor;
+
+    // Percentiles are the middle of the bins which contain them, within 1/16 of the value.
+    u64 counts[histogram_bins];
+    u64 total = 0;
+    for(size_t i = 0; i < histogram_bins; ++i) {
+        counts[i] = histogram[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    const auto percentile = [&](u64 rank) -> u64 {
+        u64 sum = 0;
+        for(size_t i = 0; i < histogram_bins; ++i) {
+            sum += counts[i];
+            if(sum <= rank) continue;
+            if(i + 1 == histogram_bins) return histogram_lower_bound(i);
+            return (histogram_lower_bound(i) + histogram_lower_bound(i + 1)) / 2;
+        }
+        return 0;
+    };
+    result.p50_ns = percentile(total * 50 / 100);
+    result.p90_ns = percentile(total * 90 / 100);
+    result.p99_ns = percentile(total * 99 / 100);
+    return result;
+}
+Profile::Profile() {
+    reset();
+}
+} // namespace boxten
@@ -0,0 +1,61 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "counter.hpp"
+#include "statistics.hpp"
+#include "type.hpp"
+
+namespace boxten {
+// Reads the cycle counter of the cpu, which is much cheaper than clocks of the system.
+// Falls back to steady_time_ns() on architectures without a known counter.
+inline u64 read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    u64 value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return steady_time_ns();
+#endif
+}
+// Measures the rate of read_cycles(). Sleeps a few milliseconds the first time, and returns immediately after that.
+void calibrate_cycles();
+u64  cycles_to_ns(u64 cycles);
+
+inline u64 packet_duration_ns(PCMPacketUnit& packet) {
+    auto& format = packet.format;
+    if(format.get_sample_bytewidth() == 0 || format.channels == 0 || format.sampling_rate == 0) return 0;
+    return packet.get_frames() * 1000000000ull / format.sampling_rate;
+}
+
+// Timing of calls to one component, such as modify_packet() of a SoundProcessor.
+// record() may be called from several threads at once, while get() is called from others.
+class Profile {
+  public:
+    static constexpr size_t histogram_bins = 256; // 8 bins per octave of nanoseconds, up to 2^32.
+
+  private:
+    std::atomic<u64> calls          = 0;
+    std::atomic<u64> over_budget    = 0;
+    std::atomic<u64> wall_ns        = 0;
+    std::atomic<u64> cpu_ns         = 0;
+    std::atomic<u64> audio_ns       = 0;
+    std::atomic<u64> max_ns         = 0;
+    std::atomic<f64> peak_factor    = 0;
+    std::atomic<u64> last_warned_ns = 0;
+    std::atomic<u64> histogram[histogram_bins];
+
+  public:
+    // 'audio' is the duration of the processed frames. 'budget' is the realtime factor allowed for one call, 0 for no limit.
+    // Returns true when the call went over the budget and the caller should warn about it. Warnings are limited to one per 5 seconds.
+    bool record(u64 wall, u64 cpu, u64 audio, f64 budget, u64 now);
+    void reset();
+    ProfileStatistics get() const;
+    Profile();
+};
+} // namespace boxten
@@ -0,0 +1,99 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <alloca.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "debug.hpp"
+#include "realtime.hpp"
+#include "config.h"
+#include "statistics.hpp"
+
+namespace boxten {
+namespace {
+constexpr u64 max_reports = 16; // do not flood stderr with a report per period.
+
+thread_local int  realtime_depth       = 0;
+thread_local int  allow_depth          = 0;
+std::atomic<u64>  realtime_allocations = 0;
+std::atomic<bool> memory_locked        = false;
+} // namespace
+
+bool lock_memory() {
+    if(memory_locked) return true;
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        DEBUG_OUT("mlockall failed.");
+        return false;
+    }
+    memory_locked = true;
+    return true;
+}
+void unlock_memory() {
+    if(!memory_locked) return;
+    munlockall();
+    memory_locked = false;
+}
+void prefault_stack(size_t bytes) {
+    auto stack = static_cast<volatile u8*>(alloca(bytes));
+    for(size_t i = 0; i < bytes; i += 4096) stack[i] = 0;
+}
+
+RealtimeSection::RealtimeSection(bool enabled) : enabled(enabled) {
+    if(enabled) realtime_depth++;
+}
+RealtimeSection::~RealtimeSection() {
+    if(enabled) realtime_depth--;
+}
+AllowAllocation::AllowAllocation() {
+    allow_depth++;
+}
+AllowAllocation::~AllowAllocation() {
+    allow_depth--;
+}
+RealtimeStatistics get_realtime_statistics() {
+    RealtimeStatistics result;
+    result.memory_locked        = memory_locked;
+    result.realtime_allocations = realtime_allocations;
+    return result;
+}
+
+#if defined(TRACK_REALTIME_ALLOCATIONS)
+namespace {
+void check_realtime_allocation() {
+    if(realtime_depth == 0 || allow_depth != 0) return;
+    if(realtime_allocations.fetch_add(1, std::memory_order_relaxed) >= max_reports) return;
+    // do not use iostream here, it may allocate.
+    constexpr char message[] = "boxten: heap allocation in realtime section!\n";
+    [[maybe_unused]] auto r  = write(STDERR_FILENO, message, sizeof(message) - 1);
+}
+} // namespace
+#endif
+} // namespace boxten
+
+#if defined(TRACK_REALTIME_ALLOCATIONS)
+void* operator new(size_t size) {
+    boxten::check_realtime_allocation();
+    if(auto p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+    boxten::check_realtime_allocation();
+    auto align = static_cast<size_t>(alignment);
+    if(auto p = std::aligned_alloc(align, (size + align - 1) / align * align)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+#endif
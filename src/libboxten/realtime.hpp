@@ -0,0 +1,28 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include "type.hpp"
+
+namespace boxten {
+// Locks current and future pages of the process into memory.
+bool lock_memory();
+void unlock_memory();
+// Touches 'bytes' of the calling thread's stack, so that it does not page-fault later.
+void prefault_stack(size_t bytes);
+
+// While a RealtimeSection is alive on a thread, the thread is expected not to allocate.
+// When built with the track_realtime_allocations option, heap allocations made inside it are reported to stderr and counted in RealtimeStatistics.
+class RealtimeSection {
+  private:
+    bool enabled;
+
+  public:
+    RealtimeSection(bool enabled = true);
+    ~RealtimeSection();
+};
+// Suspends RealtimeSection of the thread, for rare allocations which are known and accepted.
+class AllowAllocation {
+  public:
+    AllowAllocation();
+    ~AllowAllocation();
+};
+} // namespace boxten
@@ -0,0 +1,119 @@
+#include <cmath>
+#include <utility>
+
+#include "remixer.hpp"
+
+namespace boxten {
+namespace {
+using Kernel = void (*)(const f32* matrix, const f32* input, f32* output, n_frames frames, u32 inputs, u32 outputs);
+
+void mix_generic(const f32* matrix, const f32* input, f32* output, n_frames frames, u32 inputs, u32 outputs) {
+    for(n_frames f = 0; f < frames; ++f) {
+        const f32* in  = input + f * inputs;
+        f32*       out = output + f * outputs;
+        for(u32 o = 0; o < outputs; ++o) {
+            const f32* row = matrix + o * inputs;
+            f32        sum = 0.0f;
+            for(u32 i = 0; i < inputs; ++i) {
+                sum += row[i] * in[i];
+            }
+            out[o] = sum;
+        }
+    }
+}
+
+namespace generic {
+constexpr size_t vector_bytes = 16;
+#include "remixer_kernels.hpp"
+} // namespace generic
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+constexpr size_t vector_bytes = 32;
+#include "remixer_kernels.hpp"
+} // namespace avx2
+#pragma GCC pop_options
+#endif
+
+Kernel find_kernel(u32 inputs, u32 outputs) {
+    Kernel kernel = nullptr;
+#if defined(__x86_64__)
+    if(__builtin_cpu_supports("avx2")) kernel = avx2::find_kernel(inputs, outputs);
+#endif
+    if(kernel == nullptr) kernel = generic::find_kernel(inputs, outputs);
+    return kernel != nullptr ? kernel : mix_generic;
+}
+} // namespace
+
+std::vector<f32> Remixer::default_matrix(u32 inputs, u32 outputs) {
+    std::vector<f32> result(inputs * outputs, 0.0f);
+    auto             set = [&](u32 o, u32 i, f32 gain) {
+        if(o < outputs && i < inputs) result[o * inputs + i] = gain;
+    };
+    const f32 half_power = std::sqrt(0.5f);
+    if(inputs == outputs) {
+        for(u32 c = 0; c < inputs; ++c) {
+            set(c, c, 1.0f);
+        }
+    } else if(inputs == 1) {
+        // Mono goes to both of the front speakers, or to the center speaker if any.
+        if(outputs >= 3) {
+            set(2, 0, 1.0f);
+        } else {
+            set(0, 0, 1.0f);
+            set(1, 0, 1.0f);
+        }
+    } else if(outputs == 1) {
+        // Average of the stereo downmix.
+        auto stereo = default_matrix(inputs, 2);
+        for(u32 i = 0; i < inputs; ++i) {
+            set(0, i, (stereo[i] + stereo[inputs + i]) / 2);
+        }
+    } else if(outputs == 2 && (inputs == 4 || inputs == 6 || inputs == 8)) {
+        // ITU-R BS.775 style downmix. LFE is dropped.
+        set(0, 0, 1.0f);
+        set(1, 1, 1.0f);
+        if(inputs == 4) {
+            set(0, 2, half_power);
+            set(1, 3, half_power);
+        } else {
+            set(0, 2, half_power);
+            set(1, 2, half_power);
+            set(0, 4, half_power);
+            set(1, 5, half_power);
+            if(inputs == 8) {
+                set(0, 6, half_power);
+                set(1, 7, half_power);
+            }
+        }
+        // Scale so that full scale input does not clip.
+        f32 peak = 0.0f;
+        for(u32 o = 0; o < 2; ++o) {
+            f32 sum = 0.0f;
+            for(u32 i = 0; i < inputs; ++i) {
+                sum += result[o * inputs + i];
+            }
+            peak = std::max(peak, sum);
+        }
+        for(auto& g : result) {
+            g /= peak;
+        }
+    } else {
+        for(u32 c = 0; c < inputs && c < outputs; ++c) {
+            set(c, c, 1.0f);
+        }
+    }
+    return result;
+}
+void Remixer::configure(u32 inputs, u32 outputs, const std::vector<f32>& matrix) {
+    this->inputs  = inputs;
+    this->outputs = outputs;
+    this->matrix  = matrix.size() == inputs * outputs ? matrix : default_matrix(inputs, outputs);
+    kernel        = find_kernel(inputs, outputs);
+}
+void Remixer::process(const f32* input, n_frames frames, f32* output) {
+    kernel(matrix.data(), input, output, frames, inputs, outputs);
+}
+} // namespace boxten
@@ -0,0 +1,26 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <vector>
+
+#include "type.hpp"
+
+namespace boxten {
+// Mixes interleaved native_f32 frames of N channels into M channels with a matrix.
+// Channels are in the WAVE order(FL FR FC LFE BL BR SL SR).
+class Remixer {
+  private:
+    using Kernel = void (*)(const f32* matrix, const f32* input, f32* output, n_frames frames, u32 inputs, u32 outputs);
+    u32              inputs  = 0;
+    u32              outputs = 0;
+    std::vector<f32> matrix; // 'outputs' rows of 'inputs' gains.
+    Kernel           kernel = nullptr;
+
+  public:
+    // Downmixes 5.1/7.1 and quad to stereo, spreads mono, and otherwise maps channels one to one.
+    static std::vector<f32> default_matrix(u32 inputs, u32 outputs);
+
+    // An empty matrix means default_matrix().
+    void configure(u32 inputs, u32 outputs, const std::vector<f32>& matrix);
+    void process(const f32* input, n_frames frames, f32* output);
+};
+} // namespace boxten
@@ -0,0 +1,71 @@
+/* This is an internal header, which will not be installed. */
+// Mixing kernels for remixer.cpp.
+// This file is included several times, once per instruction set, into a namespace which defines 'vector_bytes'.
+// Kernels take 'lanes' frames at a time, with one vector per channel.
+
+typedef f32 vf32 __attribute__((vector_size(vector_bytes)));
+constexpr size_t lanes = vector_bytes / 4;
+
+template <u32 I, size_t... L>
+vf32 gather_channel(const f32* in, u32 channel, std::index_sequence<L...>) {
+    return vf32{in[L * I + channel]...};
+}
+
+// Shapes fixed at compile time, so that the loops are unrolled and the gains stay in registers.
+template <u32 I, u32 O>
+void mix_fixed(const f32* matrix, const f32* input, f32* output, n_frames frames, u32, u32) {
+    f32 gain[O][I];
+    for(u32 o = 0; o < O; ++o) {
+        for(u32 i = 0; i < I; ++i) {
+            gain[o][i] = matrix[o * I + i];
+        }
+    }
+    n_frames f = 0;
+    for(; f + lanes <= frames; f += lanes) {
+        const f32* in = input + f * I;
+        vf32       channel[I];
+        for(u32 i = 0; i < I; ++i) {
+            channel[i] = gather_channel<I>(in, i, std::make_index_sequence<lanes>());
+        }
+        vf32 sum[O];
+        for(u32 o = 0; o < O; ++o) {
+            sum[o] = vf32{};
+            for(u32 i = 0; i < I; ++i) {
+                sum[o] += channel[i] * gain[o][i];
+            }
+        }
+        f32* out = output + f * O;
+        for(size_t l = 0; l < lanes; ++l) {
+            for(u32 o = 0; o < O; ++o) {
+                out[l * O + o] = sum[o][l];
+            }
+        }
+    }
+    for(; f < frames; ++f) {
+        const f32* in  = input + f * I;
+        f32*       out = output + f * O;
+        for(u32 o = 0; o < O; ++o) {
+            f32 sum = 0.0f;
+            for(u32 i = 0; i < I; ++i) {
+                sum += gain[o][i] * in[i];
+            }
+            out[o] = sum;
+        }
+    }
+}
+
+#define SHAPE(i, o) \
+    if(inputs == i && outputs == o) return mix_fixed<i, o>;
+Kernel find_kernel(u32 inputs, u32 outputs) {
+    SHAPE(1, 2)
+    SHAPE(2, 1)
+    SHAPE(2, 2)
+    SHAPE(4, 2)
+    SHAPE(6, 2)
+    SHAPE(8, 2)
+    SHAPE(2, 6)
+    SHAPE(6, 6)
+    SHAPE(8, 6)
+    return nullptr;
+}
+#undef SHAPE
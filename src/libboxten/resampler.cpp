@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "resampler.hpp"
+
+namespace boxten {
+namespace {
+struct Preset {
+    size_t taps;       // at the input rate when upsampling.
+    size_t max_phases; // table size for ratios which are not simple.
+    f64    passband;   // cutoff relative to the lower nyquist frequency.
+    f64    kaiser_beta;
+};
+constexpr Preset presets[] = {
+    {16, 64, 0.85, 5.0},   // FAST
+    {32, 256, 0.91, 7.0},  // MEDIUM
+    {64, 1024, 0.95, 9.0}, // BEST
+};
+
+f64 bessel_i0(f64 x) {
+    f64 sum  = 1.0;
+    f64 term = 1.0;
+    for(int k = 1; k < 64; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if(term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+using v8f = f32 __attribute__((vector_size(32)));
+
+// Computes 'count' output frames. Built for AVX2 and baseline, the better one is picked when the library is loaded.
+__attribute__((target_clones("avx2", "default"))) size_t run_filter(const f32* coefficients, size_t taps, size_t phases, bool interpolate,
+                                                                    const f32* history, size_t row_capacity, u32 channels,
+                                                                    u64 up, u64 down, u64& phase_position, size_t& position,
+                                                                    size_t available, f32* output) {
+    alignas(32) f32 mixed[1024];
+    size_t          written = 0;
+    while(position + taps <= available) {
+        const f32* row;
+        if(interpolate) {
+            auto scaled = phase_position * phases;
+            auto index  = scaled / up;
+            v8f  weight = {};
+            weight += static_cast<f32>(scaled % up) / static_cast<f32>(up);
+            auto a = coefficients + index * taps;
+            auto b = a + taps;
+            for(size_t i = 0; i < taps; i += 8) {
+                v8f va, vb;
+                std::memcpy(&va, a + i, sizeof(v8f));
+                std::memcpy(&vb, b + i, sizeof(v8f));
+                v8f r = va + (vb - va) * weight;
+                std::memcpy(mixed + i, &r, sizeof(v8f));
+            }
+            row = mixed;
+        } else {
+            row = coefficients + phase_position * taps;
+        }
+        for(u32 c = 0; c < channels; ++c) {
+            auto input = history + c * row_capacity + position;
+            v8f  sum   = {};
+            for(size_t i = 0; i < taps; i += 8) {
+                v8f x, k;
+                std::memcpy(&x, input + i, sizeof(v8f));
+                std::memcpy(&k, row + i, sizeof(v8f));
+                sum += x * k;
+            }
+            output[written * channels + c] = ((sum[0] + sum[4]) + (sum[1] + sum[5])) + ((sum[2] + sum[6]) + (sum[3] + sum[7]));
+        }
+        written += 1;
+        phase_position += down;
+        position += phase_position / up;
+        phase_position %= up;
+    }
+    return written;
+}
+} // namespace
+
+void Resampler::design() {
+    const auto& preset = presets[static_cast<size_t>(quality)];
+    // Keep the transition band in proportion to the output rate when downsampling.
+    const f64 ratio = static_cast<f64>(up) / static_cast<f64>(down);
+    taps            = preset.taps;
+    if(ratio < 1.0) taps = static_cast<size_t>(std::ceil(taps / ratio));
+    taps   = (taps + 7) / 8 * 8;
+    phases = up <= preset.max_phases ? up : preset.max_phases;
+    if(taps > 1024) taps = 1024;
+
+    const f64 cutoff = 0.5 * std::min(1.0, ratio) * preset.passband; // in cycles per input frame.
+    const f64 half   = taps / 2.0;
+    const f64 norm   = bessel_i0(preset.kaiser_beta);
+    coefficients.assign((phases + 1) * taps, 0.0f);
+    for(size_t p = 0; p <= phases; ++p) {
+        auto row = coefficients.data() + p * taps;
+        f64  sum = 0.0;
+        for(size_t j = 0; j < taps; ++j) {
+            // distance from the output frame, which lies 'p / phases' after input frame 'half - 1'.
+            f64 x      = static_cast<f64>(j) - (half - 1.0) - static_cast<f64>(p) / phases;
+            f64 sinc   = x == 0.0 ? 1.0 : std::sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+            f64 w      = x / half;
+            f64 window = std::abs(w) >= 1.0 ? 0.0 : bessel_i0(preset.kaiser_beta * std::sqrt(1.0 - w * w)) / norm;
+            f64 value  = 2.0 * cutoff * sinc * window;
+            row[j]     = value;
+            sum += value;
+        }
+        for(size_t j = 0; j < taps; ++j) {
+            row[j] /= sum;
+        }
+    }
+}
+void Resampler::reserve(size_t frames) {
+    if(frames <= row_capacity) return;
+    std::vector<f32> grown(frames * channels);
+    for(u32 c = 0; c < channels; ++c) {
+        std::memcpy(grown.data() + c * frames, history.data() + c * row_capacity, history_frames * sizeof(f32));
+    }
+    history.swap(grown);
+    row_capacity = frames;
+}
+bool Resampler::configured(u32 input_rate, u32 output_rate, u32 channels, ResamplerQuality quality) const {
+    return this->input_rate == input_rate && this->output_rate == output_rate && this->channels == channels && this->quality == quality;
+}
+void Resampler::configure(u32 input_rate, u32 output_rate, u32 channels, ResamplerQuality quality) {
+    if(configured(input_rate, output_rate, channels, quality)) return;
+    this->input_rate  = input_rate;
+    this->output_rate = output_rate;
+    this->channels    = channels;
+    this->quality     = quality;
+    auto gcd          = std::gcd(input_rate, output_rate);
+    up                = output_rate / gcd;
+    down              = input_rate / gcd;
+    design();
+    history.clear();
+    row_capacity = 0;
+    // Room for the filter, the silence of a flush, and a packet which an earlier stage upsampled.
+    reserve(taps * 2 + PCMPACKET_PERIOD * 4);
+    reset();
+}
+void Resampler::reset() {
+    // Start with half a filter of silence, so that the first output frame lines up with the first input frame.
+    history_frames = taps / 2 - 1;
+    for(u32 c = 0; c < channels; ++c) {
+        std::fill_n(history.data() + c * row_capacity, history_frames, 0.0f);
+    }
+    phase_position = 0;
+    total_input    = 0;
+    total_output   = 0;
+}
+n_frames Resampler::max_output_frames(n_frames frames, bool flush) const {
+    return (history_frames + frames + (flush ? taps / 2 : 0)) * up / down + 1;
+}
+n_frames Resampler::process(const f32* input, n_frames frames, f32* output, bool flush) {
+    // The last input frame reaches the center of the filter after half a filter of silence.
+    const size_t padding = flush ? taps / 2 : 0;
+    reserve(history_frames + frames + padding);
+    for(u32 c = 0; c < channels; ++c) {
+        auto row = history.data() + c * row_capacity + history_frames;
+        for(n_frames i = 0; i < frames; ++i) {
+            row[i] = input[i * channels + c];
+        }
+        std::fill_n(row + frames, padding, 0.0f);
+    }
+    history_frames += frames + padding;
+    total_input += frames;
+
+    size_t position = 0;
+    auto   written  = run_filter(coefficients.data(), taps, phases, phases != up, history.data(), row_capacity, channels,
+                                 up, down, phase_position, position, history_frames, output);
+    if(flush) {
+        // Drop the frames which only the silence produced.
+        const u64 total = (total_input * up + down - 1) / down;
+        written         = total > total_output ? std::min<u64>(written, total - total_output) : 0;
+        reset();
+        return written;
+    }
+    total_output += written;
+
+    // Drop consumed frames.
+    if(position > history_frames) position = history_frames;
+    history_frames -= position;
+    for(u32 c = 0; c < channels; ++c) {
+        auto row = history.data() + c * row_capacity;
+        std::memmove(row, row + position, history_frames * sizeof(f32));
+    }
+    return written;
+}
+} // namespace boxten
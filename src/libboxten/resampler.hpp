@@ -0,0 +1,47 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <vector>
+
+#include "type.hpp"
+
+namespace boxten {
+enum class ResamplerQuality {
+    FAST,
+    MEDIUM,
+    BEST,
+};
+// Polyphase windowed-sinc sample rate converter for interleaved native_f32.
+// Unconsumed input is kept between calls, so that a stream can be converted packet by packet without clicks.
+class Resampler {
+  private:
+    u32              input_rate  = 0;
+    u32              output_rate = 0;
+    u32              channels    = 0;
+    ResamplerQuality quality     = ResamplerQuality::MEDIUM;
+    u64              up          = 1; // output_rate / input_rate == up / down
+    u64              down        = 1;
+    size_t           taps        = 0; // multiple of 8.
+    size_t           phases      = 0; // if less than up, coefficients are interpolated between neighbouring phases.
+    std::vector<f32> coefficients;    // (phases + 1) rows of taps.
+    std::vector<f32> history;         // planar input, 'channels' rows of 'row_capacity' frames.
+    size_t           row_capacity   = 0;
+    size_t           history_frames = 0;
+    u64              phase_position = 0; // fractional position of the next output frame, in 1/up input frames.
+    u64              total_input    = 0; // frames since reset().
+    u64              total_output   = 0;
+
+    void design();
+    void reserve(size_t frames);
+
+  public:
+    bool configured(u32 input_rate, u32 output_rate, u32 channels, ResamplerQuality quality) const;
+    void configure(u32 input_rate, u32 output_rate, u32 channels, ResamplerQuality quality);
+    // Forgets the stream converted so far.
+    void reset();
+    // Upper limit of the frames which process() writes for 'frames' input frames.
+    n_frames max_output_frames(n_frames frames, bool flush = false) const;
+    // Returns the number of written frames.
+    // 'flush' marks the end of the stream. The frames kept for the filter are pushed out with silence, and the stream is reset.
+    n_frames process(const f32* input, n_frames frames, f32* output, bool flush = false);
+};
+} // namespace boxten
@@ -0,0 +1,66 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include <atomic>
+#include <vector>
+
+#include "type.hpp"
+
+namespace boxten {
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// resize() must not race with push()/front()/pop().
+template <class T>
+class SPSCRing {
+  private:
+    std::vector<T> slots;
+    u64            mask = 0;
+
+    alignas(64) std::atomic<u64> head = 0; // next slot to read. written by consumer.
+    alignas(64) std::atomic<u64> tail = 0; // next slot to write. written by producer.
+
+  public:
+    void resize(size_t capacity) {
+        size_t size = 1;
+        while(size < capacity) size <<= 1;
+        slots.clear();
+        slots.resize(size);
+        mask = size - 1;
+        head = 0;
+        tail = 0;
+    }
+    size_t capacity() const {
+        return slots.size();
+    }
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+    bool full() const {
+        return size() >= capacity();
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /* producer */
+    bool push(T&& data) {
+        auto t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) >= slots.size()) return false;
+        slots[t & mask] = std::move(data);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* consumer */
+    T* front() {
+        auto h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &slots[h & mask];
+    }
+    void pop() {
+        head.fetch_add(1, std::memory_order_release);
+    }
+
+    SPSCRing(size_t capacity = 0) {
+        resize(capacity);
+    }
+};
+} // namespace boxten
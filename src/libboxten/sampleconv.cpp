@@ -0,0 +1,215 @@
+#include <cstring>
+
+#include "sampleconv.hpp"
+
+namespace boxten {
+namespace {
+// Samples are converted through a left-justified 32bit signed integer, which holds every integer type losslessly.
+constexpr size_t block_samples = 256;
+
+inline u32 load_le(const u8* p, size_t width) {
+    u32 v = 0;
+    for(size_t i = 0; i < width; ++i) v |= static_cast<u32>(p[i]) << (8 * i);
+    return v;
+}
+inline u32 load_be(const u8* p, size_t width) {
+    u32 v = 0;
+    for(size_t i = 0; i < width; ++i) v = (v << 8) | p[i];
+    return v;
+}
+inline void store_le(u8* p, u32 v, size_t width) {
+    for(size_t i = 0; i < width; ++i) p[i] = v >> (8 * i);
+}
+inline void store_be(u8* p, u32 v, size_t width) {
+    for(size_t i = 0; i < width; ++i) p[i] = v >> (8 * (width - 1 - i));
+}
+inline bool is_big_endian(SampleType type) {
+    switch(type) {
+    case SampleType::f32_be:
+    case SampleType::s16_be:
+    case SampleType::u16_be:
+    case SampleType::s24_be:
+    case SampleType::u24_be:
+    case SampleType::s32_be:
+    case SampleType::u32_be:
+        return true;
+    default:
+        return false;
+    }
+}
+inline bool is_unsigned(SampleType type) {
+    switch(type) {
+    case SampleType::u8:
+    case SampleType::u16_le:
+    case SampleType::u16_be:
+    case SampleType::u24_le:
+    case SampleType::u24_be:
+    case SampleType::u32_le:
+    case SampleType::u32_be:
+        return true;
+    default:
+        return false;
+    }
+}
+inline bool is_float(SampleType type) {
+    return type == SampleType::f32_le || type == SampleType::f32_be;
+}
+inline i32 float_to_i32(f32 v) {
+    if(v != v) return 0; // NaN.
+    if(v >= 1.0f) return 0x7FFFFFFF;
+    if(v <= -1.0f) return -0x7FFFFFFF - 1;
+    return static_cast<i32>(static_cast<f64>(v) * 2147483648.0);
+}
+inline f32 i32_to_float(i32 v) {
+    return static_cast<f32>(v * (1.0 / 2147483648.0));
+}
+
+namespace scalar {
+void decode(const u8* source, SampleType type, i32* result, size_t samples) {
+    const size_t width = get_sample_bytewidth(type);
+    const bool   be    = is_big_endian(type);
+    if(is_float(type)) {
+        for(size_t i = 0; i < samples; ++i) {
+            u32 bits = be ? load_be(source + i * 4, 4) : load_le(source + i * 4, 4);
+            f32 v;
+            std::memcpy(&v, &bits, 4);
+            result[i] = float_to_i32(v);
+        }
+        return;
+    }
+    const u32 sign  = is_unsigned(type) ? 0x80000000u : 0;
+    const u32 shift = 32 - width * 8;
+    for(size_t i = 0; i < samples; ++i) {
+        u32 v     = be ? load_be(source + i * width, width) : load_le(source + i * width, width);
+        result[i] = static_cast<i32>((v << shift) ^ sign);
+    }
+}
+void encode(const i32* source, SampleType type, u8* result, size_t samples) {
+    const size_t width = get_sample_bytewidth(type);
+    const bool   be    = is_big_endian(type);
+    if(is_float(type)) {
+        for(size_t i = 0; i < samples; ++i) {
+            f32 v = i32_to_float(source[i]);
+            u32 bits;
+            std::memcpy(&bits, &v, 4);
+            be ? store_be(result + i * 4, bits, 4) : store_le(result + i * 4, bits, 4);
+        }
+        return;
+    }
+    const u32 sign  = is_unsigned(type) ? 0x80000000u : 0;
+    const u32 shift = 32 - width * 8;
+    for(size_t i = 0; i < samples; ++i) {
+        u32 v = (static_cast<u32>(source[i]) ^ sign) >> shift;
+        be ? store_be(result + i * width, v, width) : store_le(result + i * width, v, width);
+    }
+}
+} // namespace scalar
+
+// float to float conversion must not go through integer, or values out of [-1.0, 1.0] would be lost.
+void convert_float(const u8* source, SampleType source_type, u8* destination, SampleType destination_type, size_t samples) {
+    const bool sbe = is_big_endian(source_type);
+    const bool dbe = is_big_endian(destination_type);
+    for(size_t i = 0; i < samples; ++i) {
+        u32 bits = sbe ? load_be(source + i * 4, 4) : load_le(source + i * 4, 4);
+        dbe ? store_be(destination + i * 4, bits, 4) : store_le(destination + i * 4, bits, 4);
+    }
+}
+
+namespace generic {
+#if defined(__x86_64__)
+constexpr bool has_byte_shuffle = false; // pshufb is not in the baseline.
+#else
+constexpr bool has_byte_shuffle = true;
+#endif
+constexpr size_t vector_bytes = 16;
+#include "sampleconv_kernels.hpp"
+} // namespace generic
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+constexpr bool   has_byte_shuffle = true;
+constexpr size_t vector_bytes     = 32;
+#include "sampleconv_kernels.hpp"
+} // namespace avx2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+namespace avx512 {
+constexpr bool   has_byte_shuffle = true;
+constexpr size_t vector_bytes     = 64;
+#include "sampleconv_kernels.hpp"
+} // namespace avx512
+#pragma GCC pop_options
+#endif
+
+struct Backend {
+    const char* name;
+    void (*decode)(const u8* source, SampleType type, i32* result, size_t samples);
+    void (*encode)(const i32* source, SampleType type, u8* result, size_t samples);
+};
+Backend select_backend() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512bw")) return {"avx512", avx512::decode, avx512::encode};
+    if(__builtin_cpu_supports("avx2")) return {"avx2", avx2::decode, avx2::encode};
+    return {"sse2", generic::decode, generic::encode};
+#else
+    return {"generic", generic::decode, generic::encode};
+#endif
+}
+const Backend vector_backend = select_backend();
+const Backend scalar_backend = {"scalar", scalar::decode, scalar::encode};
+
+void convert(const Backend& backend, const u8* source, SampleType source_type, u8* destination, SampleType destination_type, size_t samples) {
+    if(source_type == SampleType::unknown || destination_type == SampleType::unknown) return;
+    if(source_type == destination_type) {
+        std::memcpy(destination, source, samples * get_sample_bytewidth(source_type));
+        return;
+    }
+    if(is_float(source_type) && is_float(destination_type)) {
+        convert_float(source, source_type, destination, destination_type, samples);
+        return;
+    }
+    const size_t source_width      = get_sample_bytewidth(source_type);
+    const size_t destination_width = get_sample_bytewidth(destination_type);
+    alignas(64) i32 block[block_samples];
+    while(samples > 0) {
+        size_t n = samples < block_samples ? samples : block_samples;
+        backend.decode(source, source_type, block, n);
+        backend.encode(block, destination_type, destination, n);
+        source += n * source_width;
+        destination += n * destination_width;
+        samples -= n;
+    }
+}
+} // namespace
+
+void convert_samples(const u8* source, SampleType source_type, u8* destination, SampleType destination_type, size_t samples) {
+    convert(vector_backend, source, source_type, destination, destination_type, samples);
+}
+void convert_samples_reference(const u8* source, SampleType source_type, u8* destination, SampleType destination_type, size_t samples) {
+    convert(scalar_backend, source, source_type, destination, destination_type, samples);
+}
+const char* get_sample_conversion_backend() {
+    return vector_backend.name;
+}
+void deinterleave_samples(const f32* source, f32* destination, u32 channels, n_frames frames) {
+    for(u32 c = 0; c < channels; ++c) {
+        auto plane = destination + c * frames;
+        for(n_frames i = 0; i < frames; ++i) {
+            plane[i] = source[i * channels + c];
+        }
+    }
+}
+void interleave_samples(const f32* source, f32* destination, u32 channels, n_frames frames) {
+    for(u32 c = 0; c < channels; ++c) {
+        auto plane = source + c * frames;
+        for(n_frames i = 0; i < frames; ++i) {
+            destination[i * channels + c] = plane[i];
+        }
+    }
+}
+} // namespace boxten
@@ -0,0 +1,15 @@
+#pragma once
+#include "type.hpp"
+
+namespace boxten {
+// Converts interleaved samples between any two sample types.
+// Integer samples are scaled to the destination width, floating point samples are clipped to [-1.0, 1.0].
+// Vectorized for the running cpu(SSE2/AVX2/AVX-512 on x86-64).
+void convert_samples(const u8* source, SampleType source_type, u8* destination, SampleType destination_type, size_t samples);
+// Scalar implementation of convert_samples(), which gives the same result. For testing and benchmarking.
+void        convert_samples_reference(const u8* source, SampleType source_type, u8* destination, SampleType destination_type, size_t samples);
+const char* get_sample_conversion_backend(); // name of the instruction set convert_samples() uses.
+// Converts 'frames' frames between interleaved and planar(channel by channel) layout.
+void deinterleave_samples(const f32* source, f32* destination, u32 channels, n_frames frames);
+void interleave_samples(const f32* source, f32* destination, u32 channels, n_frames frames);
+} // namespace boxten
@@ -0,0 +1,180 @@
+/* This is an internal header, which will not be installed. */
+// Vectorized decode()/encode() for sampleconv.cpp.
+// This file is included several times, once per instruction set, into a namespace which defines
+// 'vector_bytes' (register width) and 'has_byte_shuffle' (whether byte shuffles are cheap).
+// Samples which do not fill a whole vector are left to scalar::decode()/scalar::encode().
+
+typedef u8  vu8x16 __attribute__((vector_size(16)));
+typedef u16 vu16 __attribute__((vector_size(vector_bytes / 2)));
+typedef u32 vu32 __attribute__((vector_size(vector_bytes)));
+typedef i32 vi32 __attribute__((vector_size(vector_bytes)));
+typedef f32 vf32 __attribute__((vector_size(vector_bytes)));
+constexpr size_t lanes = vector_bytes / 4;
+
+inline vu32 byteswap32(vu32 v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+inline vu16 byteswap16(vu16 v) {
+    return (v >> 8) | (v << 8);
+}
+
+// returns how many samples were done.
+size_t decode16(const u8* source, bool big_endian, u32 sign, i32* result, size_t samples) {
+    size_t i = 0;
+    for(; i + lanes <= samples; i += lanes) {
+        vu16 v;
+        std::memcpy(&v, source + i * 2, sizeof(v));
+        if(big_endian) v = byteswap16(v);
+        vu32 w = (__builtin_convertvector(v, vu32) << 16) ^ sign;
+        std::memcpy(result + i, &w, sizeof(w));
+    }
+    return i;
+}
+size_t encode16(const i32* source, bool big_endian, u32 sign, u8* result, size_t samples) {
+    size_t i = 0;
+    for(; i + lanes <= samples; i += lanes) {
+        vu32 w;
+        std::memcpy(&w, source + i, sizeof(w));
+        vu16 v = __builtin_convertvector((w ^ sign) >> 16, vu16);
+        if(big_endian) v = byteswap16(v);
+        std::memcpy(result + i * 2, &v, sizeof(v));
+    }
+    return i;
+}
+size_t decode32(const u8* source, bool big_endian, u32 sign, i32* result, size_t samples) {
+    size_t i = 0;
+    for(; i + lanes <= samples; i += lanes) {
+        vu32 v;
+        std::memcpy(&v, source + i * 4, sizeof(v));
+        if(big_endian) v = byteswap32(v);
+        v ^= sign;
+        std::memcpy(result + i, &v, sizeof(v));
+    }
+    return i;
+}
+size_t encode32(const i32* source, bool big_endian, u32 sign, u8* result, size_t samples) {
+    size_t i = 0;
+    for(; i + lanes <= samples; i += lanes) {
+        vu32 v;
+        std::memcpy(&v, source + i, sizeof(v));
+        v ^= sign;
+        if(big_endian) v = byteswap32(v);
+        std::memcpy(result + i * 4, &v, sizeof(v));
+    }
+    return i;
+}
+// Same clipping as scalar::float_to_i32(): [-1.0, 1.0) maps to the whole i32 range, and NaN to 0.
+size_t decode_float(const u8* source, bool big_endian, i32* result, size_t samples) {
+    const vf32 scale = vf32{} + 2147483648.0f;
+    const vf32 upper = vf32{} + 2147483520.0f; // the largest float below 2^31.
+    const vf32 lower = vf32{} - 2147483648.0f;
+    size_t     i     = 0;
+    for(; i + lanes <= samples; i += lanes) {
+        vu32 bits;
+        std::memcpy(&bits, source + i * 4, sizeof(bits));
+        if(big_endian) bits = byteswap32(bits);
+        vf32 v;
+        std::memcpy(&v, &bits, sizeof(v));
+        v               = v == v ? v * scale : vf32{};
+        const vi32 over = v >= scale;
+        v               = v < upper ? v : upper;
+        v               = v > lower ? v : lower;
+        vi32 r          = __builtin_convertvector(v, vi32);
+        r               = over ? (vi32{} + 0x7FFFFFFF) : r;
+        std::memcpy(result + i, &r, sizeof(r));
+    }
+    return i;
+}
+size_t encode_float(const i32* source, bool big_endian, u8* result, size_t samples) {
+    const vf32 scale = vf32{} + static_cast<f32>(1.0 / 2147483648.0);
+    size_t     i     = 0;
+    for(; i + lanes <= samples; i += lanes) {
+        vi32 w;
+        std::memcpy(&w, source + i, sizeof(w));
+        vf32 v = __builtin_convertvector(w, vf32) * scale;
+        vu32 bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        if(big_endian) bits = byteswap32(bits);
+        std::memcpy(result + i * 4, &bits, sizeof(bits));
+    }
+    return i;
+}
+// Packed 24bit samples are shuffled 4 at a time. 16 bytes are loaded for 12 bytes of samples,
+// so stop while a whole 16 bytes are still in the source.
+size_t decode24(const u8* source, bool big_endian, u32 sign, i32* result, size_t samples) {
+    if(!has_byte_shuffle) return 0;
+    // index 16 picks zero from the second operand.
+    const vu8x16 le   = {16, 0, 1, 2, 16, 3, 4, 5, 16, 6, 7, 8, 16, 9, 10, 11};
+    const vu8x16 be   = {16, 2, 1, 0, 16, 5, 4, 3, 16, 8, 7, 6, 16, 11, 10, 9};
+    const vu8x16 mask = big_endian ? be : le;
+    const vu8x16 zero = {};
+    size_t       i    = 0;
+    for(; i + 6 <= samples; i += 4) {
+        vu8x16 v;
+        std::memcpy(&v, source + i * 3, sizeof(v));
+        v = __builtin_shuffle(v, zero, mask);
+        u32 w[4];
+        std::memcpy(w, &v, sizeof(w));
+        for(size_t j = 0; j < 4; ++j) result[i + j] = w[j] ^ sign;
+    }
+    return i;
+}
+size_t encode24(const i32* source, bool big_endian, u32 sign, u8* result, size_t samples) {
+    if(!has_byte_shuffle) return 0;
+    const vu8x16 le   = {1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, 0, 0, 0, 0};
+    const vu8x16 be   = {3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, 0, 0, 0, 0};
+    const vu8x16 mask = big_endian ? be : le;
+    size_t       i    = 0;
+    for(; i + 4 <= samples; i += 4) {
+        u32 w[4];
+        for(size_t j = 0; j < 4; ++j) w[j] = source[i + j] ^ sign;
+        vu8x16 v;
+        std::memcpy(&v, w, sizeof(v));
+        v = __builtin_shuffle(v, mask);
+        std::memcpy(result + i * 3, &v, 12);
+    }
+    return i;
+}
+
+void decode(const u8* source, SampleType type, i32* result, size_t samples) {
+    const bool be   = is_big_endian(type);
+    const u32  sign = is_unsigned(type) ? 0x80000000u : 0;
+    size_t     done = 0;
+    if(is_float(type)) {
+        done = decode_float(source, be, result, samples);
+    } else {
+        switch(get_sample_bytewidth(type)) {
+        case 2:
+            done = decode16(source, be, sign, result, samples);
+            break;
+        case 3:
+            done = decode24(source, be, sign, result, samples);
+            break;
+        case 4:
+            done = decode32(source, be, sign, result, samples);
+            break;
+        }
+    }
+    scalar::decode(source + done * get_sample_bytewidth(type), type, result + done, samples - done);
+}
+void encode(const i32* source, SampleType type, u8* result, size_t samples) {
+    const bool be   = is_big_endian(type);
+    const u32  sign = is_unsigned(type) ? 0x80000000u : 0;
+    size_t     done = 0;
+    if(is_float(type)) {
+        done = encode_float(source, be, result, samples);
+    } else {
+        switch(get_sample_bytewidth(type)) {
+        case 2:
+            done = encode16(source, be, sign, result, samples);
+            break;
+        case 3:
+            done = encode24(source, be, sign, result, samples);
+            break;
+        case 4:
+            done = encode32(source, be, sign, result, samples);
+            break;
+        }
+    }
+    scalar::encode(source + done, type, result + done * get_sample_bytewidth(type), samples - done);
+}
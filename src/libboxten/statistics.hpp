@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+
+#include "type.hpp"
+
+namespace boxten {
+class SoundProcessor;
+
+struct LatencyStatistics {
+    u64 count;
+    u64 total_ns;
+    u64 max_ns;
+    u64 last_ns;
+    f64 average_ns;
+};
+
+constexpr size_t buffer_histogram_bins = 16;
+constexpr size_t freeze_history_length = 16;
+
+// Counted since the latest start_playback().
+struct BufferStatistics {
+    u64      wakeups;            // how many times the fill thread was woken.
+    u64      bursts;             // wakeups which decoded at least one packet.
+    n_frames last_burst_frames;  // frames decoded by the latest burst.
+    n_frames max_burst_frames;
+    n_frames total_burst_frames;
+    n_frames low_watermark;
+    n_frames high_watermark;
+    n_frames buffer_limit;       // current buffer length. changes with sampling rate and adaptive sizing.
+    n_frames unfreeze_threshold;
+    u64      played_ns;          // duration of output_frames.
+    u64      fill_cpu_ns;        // cpu time consumed by the fill thread.
+    f64      wakeups_per_minute; // of played audio.
+    f64      fill_cpu_seconds_per_hour;
+    n_frames output_frames;      // frames handed to StreamOutput.
+    n_frames copied_frames;      // frames among output_frames which were copied between decoder and output.
+
+    // fill level sampled on every read by StreamOutput. bin n counts reads with filled frames in [n, n + 1) / bins of buffer_limit.
+    u64               fill_histogram[buffer_histogram_bins];
+    u64               underruns;
+    LatencyStatistics freeze;         // from an underrun until the output is resumed.
+    u64               recent_freezes_ns[freeze_history_length]; // durations of the latest freezes, oldest first.
+    size_t            recent_freezes;                           // valid entries of recent_freezes_ns.
+    LatencyStatistics refill_latency; // from a refill request until the fill thread finished the burst.
+    LatencyStatistics decode_time;    // StreamInput::read_frames() per packet.
+};
+struct PCMPoolStatistics {
+    u64 hits;         // allocations served from a free block.
+    u64 misses;       // allocations which had to grow the pool.
+    u64 heap_allocs;  // allocations larger than a block or made after the pool ran out, which bypass the pool.
+    u64 blocks;
+    u64 free_blocks;
+    u64 pooled_bytes; // memory owned by the pool.
+};
+// One per thread of the pipelined DSP mode. Packets wait queue_time + process_time in each of them,
+// which is added to the output latency.
+struct DSPThreadStatistics {
+    size_t            first_stage;    // index in the DSP chain.
+    size_t            stages;         // the last thread also runs the output conversion.
+    size_t            queue_capacity; // packets.
+    size_t            queued;         // packets waiting now.
+    LatencyStatistics process_time;   // per packet.
+    LatencyStatistics queue_time;     // from being queued until processing started.
+};
+// Timing of calls to a component, counted since the latest start_playback(). Not counted if "dsp_profile" is false.
+struct ProfileStatistics {
+    u64 calls;
+    u64 over_budget; // calls which took longer than "dsp_budget" of the duration of their frames.
+    u64 wall_ns;
+    u64 cpu_ns;      // cpu time of the calling thread.
+    u64 audio_ns;    // duration of the processed frames.
+    u64 p50_ns;      // wall time per call. percentiles are within 1/16 of the exact value.
+    u64 p90_ns;
+    u64 p99_ns;
+    u64 max_ns;
+    f64 realtime_factor;      // wall_ns / audio_ns. 1.0 means the component alone takes as long as the audio plays.
+    f64 peak_realtime_factor; // of the slowest call.
+};
+struct ProcessorStatistics {
+    const SoundProcessor* processor;
+    size_t                index; // in the DSP chain.
+    ProfileStatistics     profile; // of modify_packet() or modify_block().
+};
+struct RealtimeStatistics {
+    bool memory_locked;
+    u64  realtime_allocations; // heap allocations from the fill and output paths in realtime memory mode. counted only when built with track_realtime_allocations.
+};
+
+enum class AudioThread {
+    FILL,     // decodes and processes packets into the buffer.
+    PLAYBACK, // runs playback commands.
+    OUTPUT,   // the StreamOutput thread which reads the buffer.
+    DSP,      // runs a group of SoundProcessors in the pipelined mode.
+};
+enum class SchedulingPolicy {
+    OTHER,
+    FIFO,
+    RR,
+};
+// What was actually applied to the thread, which may differ from the configuration if permissions are missing.
+struct ThreadSchedulingReport {
+    bool             applied;          // false until the thread applied its policy.
+    SchedulingPolicy requested_policy;
+    SchedulingPolicy policy;
+    int              priority;         // for FIFO and RR.
+    int              nice;             // for OTHER.
+    bool             affinity_applied; // false if no affinity was configured or it failed.
+};
+
+BufferStatistics   get_buffer_statistics();
+PCMPoolStatistics  get_pcm_pool_statistics();
+RealtimeStatistics get_realtime_statistics();
+std::vector<DSPThreadStatistics> get_dsp_thread_statistics(); // empty unless "dsp_threads" is set.
+std::vector<ProcessorStatistics> get_processor_statistics();  // of the latest DSP chain.
+ProfileStatistics                get_decoder_statistics();    // of StreamInput::read_frames().
+ThreadSchedulingReport get_thread_scheduling_report(AudioThread thread);
+} // namespace boxten
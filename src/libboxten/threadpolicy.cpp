@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "configuration.hpp"
+#include "debug.hpp"
+#include "jsontest.hpp"
+#include "threadpolicy.hpp"
+
+namespace boxten {
+namespace {
+constexpr size_t      thread_roles             = 4;
+constexpr const char* role_names[thread_roles] = {"fill", "playback", "output", "dsp"};
+
+struct ThreadPolicy {
+    SchedulingPolicy policy         = SchedulingPolicy::OTHER;
+    int              priority       = 0;
+    int              nice           = 0;
+    bool             set_scheduling = false; // false leaves the policy and nice value of the thread as they are.
+    cpu_set_t        cpus;
+    bool             set_cpus = false;
+};
+SafeVar<std::array<ThreadPolicy, thread_roles>>           policies;
+SafeVar<std::array<ThreadSchedulingReport, thread_roles>> reports;
+std::atomic<u32>                                          policy_generation  = 1;
+thread_local u32                                          applied_generation = 0;
+
+int to_native(SchedulingPolicy policy) {
+    switch(policy) {
+    case SchedulingPolicy::FIFO:
+        return SCHED_FIFO;
+    case SchedulingPolicy::RR:
+        return SCHED_RR;
+    default:
+        return SCHED_OTHER;
+    }
+}
+SchedulingPolicy from_native(int policy) {
+    switch(policy) {
+    case SCHED_FIFO:
+        return SchedulingPolicy::FIFO;
+    case SCHED_RR:
+        return SchedulingPolicy::RR;
+    default:
+        return SchedulingPolicy::OTHER;
+    }
+}
+ThreadPolicy parse_policy(const nlohmann::json& cfg) {
+    ThreadPolicy result;
+    CPU_ZERO(&result.cpus);
+    if(!cfg.is_object()) return result;
+    result.set_scheduling = cfg.contains("policy") || cfg.contains("priority") || cfg.contains("nice");
+    if(std::string policy; type_check("policy", JSON_TYPE::STRING, cfg)) {
+        policy = cfg["policy"].get<std::string>();
+        if(policy == "fifo") {
+            result.policy = SchedulingPolicy::FIFO;
+        } else if(policy == "rr") {
+            result.policy = SchedulingPolicy::RR;
+        } else if(policy != "other") {
+            DEBUG_OUT("unknown scheduling policy \"" << policy << "\".");
+        }
+    }
+    if(type_check("priority", JSON_TYPE::NUMBER, cfg)) result.priority = cfg["priority"].get<int>();
+    if(type_check("nice", JSON_TYPE::NUMBER, cfg)) result.nice = cfg["nice"].get<int>();
+    if(array_type_check("cpus", JSON_TYPE::NUMBER, cfg)) {
+        for(auto& c : cfg["cpus"]) {
+            auto cpu = c.get<int>();
+            if(cpu < 0 || cpu >= CPU_SETSIZE) continue;
+            CPU_SET(cpu, &result.cpus);
+            result.set_cpus = true;
+        }
+    }
+    return result;
+}
+int current_nice() {
+    errno = 0;
+    auto nice = getpriority(PRIO_PROCESS, syscall(SYS_gettid));
+    return errno == 0 ? nice : 0;
+}
+} // namespace
+
+void load_thread_policies() {
+    nlohmann::json config_data;
+    config::load_configuration(config_data);
+    {
+        std::lock_guard<std::mutex> lock(policies.lock);
+        for(size_t i = 0; i < thread_roles; ++i) {
+            policies.data[i] = config_data.is_object() && type_check("threads", JSON_TYPE::OBJECT, config_data) && config_data["threads"].contains(role_names[i])
+                                   ? parse_policy(config_data["threads"][role_names[i]])
+                                   : parse_policy(nlohmann::json());
+        }
+    }
+    policy_generation.fetch_add(1, std::memory_order_release);
+}
+void apply_thread_policy(AudioThread role) {
+    const auto   index = static_cast<size_t>(role);
+    ThreadPolicy policy;
+    {
+        std::lock_guard<std::mutex> lock(policies.lock);
+        policy = policies.data[index];
+    }
+    const auto self = pthread_self();
+    const auto tid  = syscall(SYS_gettid);
+
+    ThreadSchedulingReport report;
+    report.applied          = true;
+    report.requested_policy = policy.policy;
+
+    // Roles without configuration keep what their creator gave them, such as a realtime thread of an output backend.
+    bool realtime = false;
+    if(policy.set_scheduling && policy.policy != SchedulingPolicy::OTHER) {
+        auto        native = to_native(policy.policy);
+        sched_param param;
+        param.sched_priority = std::clamp(policy.priority, sched_get_priority_min(native), sched_get_priority_max(native));
+        auto error           = pthread_setschedparam(self, native, &param);
+        realtime             = error == 0;
+        if(!realtime) {
+            DEBUG_OUT("cannot set realtime scheduling policy for " << role_names[index] << " thread(" << error << ").");
+        }
+    }
+    if(policy.set_scheduling && !realtime) {
+        sched_param param;
+        param.sched_priority = 0;
+        pthread_setschedparam(self, SCHED_OTHER, &param);
+        // negative nice values need permission. keep the default if it fails.
+        if(setpriority(PRIO_PROCESS, tid, policy.nice) != 0) {
+            DEBUG_OUT("cannot set nice value for " << role_names[index] << " thread.");
+        }
+    }
+    report.affinity_applied = policy.set_cpus && pthread_setaffinity_np(self, sizeof(cpu_set_t), &policy.cpus) == 0;
+
+    int         native;
+    sched_param param;
+    if(pthread_getschedparam(self, &native, &param) == 0) {
+        report.policy   = from_native(native);
+        report.priority = param.sched_priority;
+    } else {
+        report.policy   = SchedulingPolicy::OTHER;
+        report.priority = 0;
+    }
+    report.nice = current_nice();
+
+    std::lock_guard<std::mutex> lock(reports.lock);
+    reports.data[index] = report;
+}
+void apply_thread_policy_once(AudioThread role) {
+    auto generation = policy_generation.load(std::memory_order_acquire);
+    if(applied_generation == generation) return;
+    applied_generation = generation;
+    apply_thread_policy(role);
+}
+ThreadSchedulingReport get_thread_scheduling_report(AudioThread thread) {
+    std::lock_guard<std::mutex> lock(reports.lock);
+    return reports.data[static_cast<size_t>(thread)];
+}
+} // namespace boxten
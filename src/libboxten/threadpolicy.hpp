@@ -0,0 +1,14 @@
+/* This is an internal header, which will not be installed. */
+#pragma once
+#include "statistics.hpp"
+
+namespace boxten {
+// Reads the "threads" section of boxten configuration. Threads pick the change up at their next apply_thread_policy().
+void load_thread_policies();
+// Applies the configured scheduling policy, priority and cpu affinity of the role to the calling thread.
+// The scheduling of roles which have no "policy", "priority" or "nice" is left untouched.
+// Falls back to SCHED_OTHER(and then to the default nice value) if it is not permitted.
+void apply_thread_policy(AudioThread role);
+// Same as apply_thread_policy(), but only once per load_thread_policies() for each thread.
+void apply_thread_policy_once(AudioThread role);
+} // namespace boxten
@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <cstdint>
 #include <map>
 #include <mutex>
@@ -64,32 +65,104 @@ inline size_t get_sample_bytewidth(SampleType type) {
         return 0;
     }
 }
+// f32 in the byte order of the running cpu.
+constexpr SampleType native_f32 = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? SampleType::f32_le : SampleType::f32_be;
 struct PCMFormat {
     SampleType sample_type;
     u32        channels;
     u32        sampling_rate;
+    bool       planar = false; // if true, samples are stored channel by channel instead of frame by frame. only used with native_f32.
     size_t     get_sample_bytewidth() {
         return boxten::get_sample_bytewidth(sample_type);
     }
     bool operator==(const PCMFormat& a) const {
         return sample_type == a.sample_type &&
                channels == a.channels &&
-               sampling_rate == a.sampling_rate;
+               sampling_rate == a.sampling_rate &&
+               planar == a.planar;
     }
     bool operator!=(const PCMFormat& a) const {
         return !operator==(a);
     }
 };
+// Formats which a component can handle. Empty lists mean any value.
+struct FormatCapabilities {
+    std::vector<SampleType> sample_types; // in order of preference.
+    std::vector<u32>        sampling_rates;
+    std::vector<u32>        channels;
+    bool                    planar = false; // if true, packets are passed as planar native_f32.
+    bool                    accepts_sample_type(SampleType type) const {
+        if(planar && type != native_f32) return false;
+        if(sample_types.empty()) return true;
+        for(auto t : sample_types) {
+            if(t == type) return true;
+        }
+        return false;
+    }
+    bool accepts(const PCMFormat& format) const {
+        auto contains = [](const std::vector<u32>& list, u32 value) {
+            if(list.empty()) return true;
+            for(auto v : list) {
+                if(v == value) return true;
+            }
+            return false;
+        };
+        return format.planar == planar && accepts_sample_type(format.sample_type) &&
+               contains(sampling_rates, format.sampling_rate) && contains(channels, format.channels);
+    }
+};
 constexpr n_frames PCMPACKET_PERIOD = 512;
+
+// PCM storage is taken from a pool of 64-byte aligned blocks, which are recycled once the output releases them.
+void* allocate_pcm_storage(size_t bytes);
+void  free_pcm_storage(void* pointer);
+template <class T>
+struct PCMAllocator {
+    using value_type = T;
+    T* allocate(size_t n) {
+        return static_cast<T*>(allocate_pcm_storage(n * sizeof(T)));
+    }
+    void deallocate(T* pointer, size_t) {
+        free_pcm_storage(pointer);
+    }
+    template <class U>
+    bool operator==(const PCMAllocator<U>&) const {
+        return true;
+    }
+    template <class U>
+    bool operator!=(const PCMAllocator<U>&) const {
+        return false;
+    }
+    PCMAllocator() = default;
+    template <class U>
+    PCMAllocator(const PCMAllocator<U>&) {}
+};
+using PCMStorage = std::vector<u8, PCMAllocator<u8>>;
+
 struct PCMPacketUnit {
     PCMFormat       format;
     u64             original_frame_pos[2];
-    std::vector<u8> pcm;
+    PCMStorage      pcm;
     n_frames        get_frames() {
         return pcm.size() / get_sample_bytewidth(format.sample_type) / format.channels;
     }
 };
 using PCMPacket     = std::vector<PCMPacketUnit>;
+// Frames which an in-place SoundProcessor modifies at once. See SoundProcessor::modify_block().
+struct PCMBlock {
+    PCMFormat      format;
+    u64            original_frame_pos[2];
+    u8*            pcm; // planar blocks hold 'frames' samples of each channel in turn.
+    n_frames       frames;
+    PCMPacketUnit* packet        = nullptr; // the packet which holds exactly these frames, if any.
+    bool           discontinuous = false;   // the stream jumped before this block, e.g. by a seek. state kept for earlier frames should be dropped.
+};
+// Frames which encoders add to the start(delay) and the end(padding) of lossy streams.
+// They are not part of the song, and trimmed for gapless playback.
+struct GaplessInfo {
+    n_frames delay   = 0;
+    n_frames padding = 0;
+};
 using ComponentName = std::array<std::string, 2>;
 using AudioTag      = std::map<std::string, std::string>;
 struct LayoutData {
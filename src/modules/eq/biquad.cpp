@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "biquad.hpp"
+
+namespace eq {
+namespace {
+namespace generic {
+constexpr size_t vector_bytes = 16;
+#include "biquad_kernels.hpp"
+} // namespace generic
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+constexpr size_t vector_bytes = 32;
+#include "biquad_kernels.hpp"
+} // namespace avx2
+#pragma GCC pop_options
+#endif
+
+// Coefficients from "Cookbook formulae for audio EQ biquad filter coefficients" by R. Bristow-Johnson.
+Section design_section(const Band& band, u32 sampling_rate) {
+    const auto w0    = 2 * M_PI * band.frequency / sampling_rate;
+    const auto cosw  = std::cos(w0);
+    const auto alpha = std::sin(w0) / (2 * band.q);
+    const auto a     = std::pow(10.0, band.gain / 40);
+    const auto beta  = 2 * std::sqrt(a) * alpha;
+    f64        b0 = 1, b1 = 0, b2 = 0, a0 = 1, a1 = 0, a2 = 0;
+    switch(band.type) {
+    case FilterType::PEAKING:
+        b0 = 1 + alpha * a;
+        b1 = -2 * cosw;
+        b2 = 1 - alpha * a;
+        a0 = 1 + alpha / a;
+        a1 = -2 * cosw;
+        a2 = 1 - alpha / a;
+        break;
+    case FilterType::LOW_SHELF:
+        b0 = a * ((a + 1) - (a - 1) * cosw + beta);
+        b1 = 2 * a * ((a - 1) - (a + 1) * cosw);
+        b2 = a * ((a + 1) - (a - 1) * cosw - beta);
+        a0 = (a + 1) + (a - 1) * cosw + beta;
+        a1 = -2 * ((a - 1) + (a + 1) * cosw);
+        a2 = (a + 1) + (a - 1) * cosw - beta;
+        break;
+    case FilterType::HIGH_SHELF:
+        b0 = a * ((a + 1) + (a - 1) * cosw + beta);
+        b1 = -2 * a * ((a - 1) + (a + 1) * cosw);
+        b2 = a * ((a + 1) + (a - 1) * cosw - beta);
+        a0 = (a + 1) - (a - 1) * cosw + beta;
+        a1 = 2 * ((a - 1) - (a + 1) * cosw);
+        a2 = (a + 1) - (a - 1) * cosw - beta;
+        break;
+    case FilterType::LOW_PASS:
+        b0 = (1 - cosw) / 2;
+        b1 = 1 - cosw;
+        b2 = (1 - cosw) / 2;
+        a0 = 1 + alpha;
+        a1 = -2 * cosw;
+        a2 = 1 - alpha;
+        break;
+    case FilterType::HIGH_PASS:
+        b0 = (1 + cosw) / 2;
+        b1 = -(1 + cosw);
+        b2 = (1 + cosw) / 2;
+        a0 = 1 + alpha;
+        a1 = -2 * cosw;
+        a2 = 1 - alpha;
+        break;
+    }
+    return Section{b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+}
+} // namespace
+
+Design design(const std::vector<Band>& bands, f64 preamp, u32 sampling_rate) {
+    Design result;
+    result.sampling_rate = sampling_rate;
+    result.preamp        = std::pow(10.0, preamp / 20);
+    for(auto& b : bands) {
+        if(result.count == max_bands) break;
+        if(b.frequency <= 0 || b.q <= 0 || b.frequency >= sampling_rate * 0.49) continue;
+        result.sections[result.count] = design_section(b, sampling_rate);
+        result.count += 1;
+    }
+    return result;
+}
+
+void Cascade::reset() {
+    for(auto& section : states) {
+        for(auto& s : section) {
+            s.fill(0);
+        }
+    }
+}
+void Cascade::process(f32* pcm, n_frames frames, u32 channels, const Design& design) {
+    kernel(pcm, frames, channels, design, states);
+}
+Cascade::Cascade() {
+    kernel = generic::process;
+#if defined(__x86_64__)
+    if(__builtin_cpu_supports("avx2")) kernel = avx2::process;
+#endif
+    reset();
+}
+} // namespace eq
@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <vector>
+
+#include <type.hpp>
+
+namespace eq {
+using boxten::n_frames;
+
+constexpr size_t max_bands    = 32;
+constexpr size_t max_channels = 32;
+
+enum class FilterType {
+    PEAKING,
+    LOW_SHELF,
+    HIGH_SHELF,
+    LOW_PASS,
+    HIGH_PASS,
+};
+struct Band {
+    FilterType type;
+    f64        frequency; // Hz.
+    f64        gain;      // dB. not used by LOW_PASS and HIGH_PASS.
+    f64        q;
+};
+// Normalized coefficients of one section.
+struct Section {
+    f64 b0;
+    f64 b1;
+    f64 b2;
+    f64 a1;
+    f64 a2;
+};
+// Coefficients of the whole cascade for one sampling rate. Immutable once published.
+struct Design {
+    u32                            sampling_rate;
+    size_t                         count = 0; // of sections.
+    f64                            preamp;
+    std::array<Section, max_bands> sections;
+};
+// Bands above the Nyquist frequency are skipped.
+Design design(const std::vector<Band>& bands, f64 preamp, u32 sampling_rate);
+
+// Filter state of every channel, in 64 bits so that low and narrow bands keep their precision.
+// Channels are filtered side by side, one in each lane of vectors.
+class Cascade {
+  public:
+    using States = std::array<std::array<std::array<f64, max_channels>, 2>, max_bands>; // [section][s1, s2][channel]
+    using Kernel = void (*)(f32* pcm, n_frames frames, u32 channels, const Design& design, States& states);
+
+  private:
+    States states;
+    Kernel kernel;
+
+  public:
+    void reset();
+    // Filters interleaved native_f32 frames in place. 'channels' must not exceed max_channels.
+    void process(f32* pcm, n_frames frames, u32 channels, const Design& design);
+    Cascade();
+};
+} // namespace eq
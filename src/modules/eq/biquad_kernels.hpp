@@ -0,0 +1,47 @@
+// Filter kernels for biquad.cpp.
+// This file is included several times, once per instruction set, into a namespace which defines 'vector_bytes'.
+// Every lane is a channel, and the sections run one after another for each frame, in transposed direct form II.
+
+typedef f64 vf64 __attribute__((vector_size(vector_bytes)));
+typedef f32 vf32 __attribute__((vector_size(vector_bytes / 2)));
+constexpr size_t lanes = vector_bytes / sizeof(f64);
+
+void process(f32* const pcm, const n_frames frames, const u32 channels, const Design& design, Cascade::States& states) {
+    const auto count = design.count;
+    for(u32 group = 0; group < channels; group += lanes) {
+        const auto width = std::min<u32>(lanes, channels - group);
+        vf64       s1[max_bands];
+        vf64       s2[max_bands];
+        for(size_t i = 0; i < count; ++i) {
+            std::memcpy(&s1[i], &states[i][0][group], sizeof(vf64));
+            std::memcpy(&s2[i], &states[i][1][group], sizeof(vf64));
+        }
+        auto frame = pcm + group;
+        for(n_frames f = 0; f < frames; ++f, frame += channels) {
+            vf32 input = {};
+            std::memcpy(&input, frame, width * sizeof(f32));
+            auto x = __builtin_convertvector(input, vf64) * design.preamp;
+            for(size_t i = 0; i < count; ++i) {
+                const auto& c = design.sections[i];
+                const auto  y = c.b0 * x + s1[i];
+                s1[i]         = c.b1 * x - c.a1 * y + s2[i];
+                s2[i]         = c.b2 * x - c.a2 * y;
+                x             = y;
+            }
+            const auto output = __builtin_convertvector(x, vf32);
+            std::memcpy(frame, &output, width * sizeof(f32));
+        }
+        for(size_t i = 0; i < count; ++i) {
+            std::memcpy(&states[i][0][group], &s1[i], sizeof(vf64));
+            std::memcpy(&states[i][1][group], &s2[i], sizeof(vf64));
+        }
+    }
+    // Flush states which decayed to nearly zero, so that silence never reaches denormal numbers.
+    for(size_t i = 0; i < count; ++i) {
+        for(auto& s : states[i]) {
+            for(u32 c = 0; c < channels; ++c) {
+                if(std::abs(s[c]) < 1e-30) s[c] = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,151 @@
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+#include <jsontest.hpp>
+#include <libboxten.hpp>
+
+#include "biquad.hpp"
+
+namespace eq {
+namespace {
+// Coefficients are designed for these rates in advance. Packets of other rates are resampled by the engine.
+constexpr u32 sampling_rates[] = {8000, 11025, 16000, 22050, 32000, 44100, 48000, 64000, 88200, 96000, 176400, 192000, 352800, 384000};
+// Center frequencies of the "graphic" bands.
+constexpr f64 graphic_frequencies[] = {31.25, 62.5, 125, 250, 500, 1000, 2000, 4000, 8000, 16000};
+} // namespace
+
+// Parametric and graphic equalizer. Configuration:
+//   "preamp":  gain in dB applied before the bands.
+//   "bands":   [{"type": "peaking"(default), "low_shelf", "high_shelf", "low_pass" or "high_pass", "frequency": Hz, "gain": dB, "q": Q(default 0.707)}, ...]
+//   "graphic": [gains in dB of the octave bands from 31.25 Hz to 16 kHz]. added after "bands".
+// The configuration is read again on every start of playback, on the hook thread, and swapped in without locking the audio thread.
+class Equalizer : public boxten::SoundProcessor {
+  private:
+    using Designs = std::vector<Design>; // one for each of sampling_rates.
+
+    std::mutex                            designs_lock; // for writers.
+    std::vector<std::unique_ptr<Designs>> designs;      // published and not freed yet.
+    std::atomic<Designs*>                 current = nullptr;
+    std::atomic<Designs*>                 in_use  = nullptr; // hazard pointer of the audio thread.
+
+    // used by the audio thread only.
+    Cascade cascade;
+    u32     sampling_rate = 0;
+    u32     channels      = 0;
+
+    std::vector<Band> load_bands(f64& preamp) {
+        nlohmann::json    config_data;
+        std::vector<Band> bands;
+        preamp = 0;
+        if(!load_configuration(config_data) || !config_data.is_object()) return bands;
+        if(boxten::type_check("preamp", boxten::JSON_TYPE::NUMBER, config_data)) {
+            preamp = config_data["preamp"].get<f64>();
+        }
+        if(boxten::array_type_check("bands", boxten::JSON_TYPE::OBJECT, config_data)) {
+            for(auto& b : config_data["bands"]) {
+                Band band{FilterType::PEAKING, 1000, 0, 0.707};
+                if(boxten::type_check("type", boxten::JSON_TYPE::STRING, b)) {
+                    auto type = b["type"].get<std::string>();
+                    if(type == "low_shelf") {
+                        band.type = FilterType::LOW_SHELF;
+                    } else if(type == "high_shelf") {
+                        band.type = FilterType::HIGH_SHELF;
+                    } else if(type == "low_pass") {
+                        band.type = FilterType::LOW_PASS;
+                    } else if(type == "high_pass") {
+                        band.type = FilterType::HIGH_PASS;
+                    }
+                }
+                if(boxten::type_check("frequency", boxten::JSON_TYPE::NUMBER, b)) band.frequency = b["frequency"].get<f64>();
+                if(boxten::type_check("gain", boxten::JSON_TYPE::NUMBER, b)) band.gain = b["gain"].get<f64>();
+                if(boxten::type_check("q", boxten::JSON_TYPE::NUMBER, b)) band.q = b["q"].get<f64>();
+                bands.emplace_back(band);
+            }
+        }
+        if(boxten::array_type_check("graphic", boxten::JSON_TYPE::NUMBER, config_data)) {
+            auto& gains = config_data["graphic"];
+            for(size_t i = 0; i < gains.size() && i < std::size(graphic_frequencies); ++i) {
+                const auto gain = gains[i].get<f64>();
+                if(gain == 0) continue;
+                bands.emplace_back(Band{FilterType::PEAKING, graphic_frequencies[i], gain, 1.414});
+            }
+        }
+        if(bands.size() > max_bands) {
+            console.warning << "only the first " << max_bands << " bands are used." << std::endl;
+        }
+        return bands;
+    }
+    // Designs coefficients for every sampling rate and publishes them. Called off the audio thread.
+    void load() {
+        f64        preamp;
+        const auto bands = load_bands(preamp);
+        auto       next  = std::make_unique<Designs>();
+        for(auto rate : sampling_rates) {
+            next->emplace_back(eq::design(bands, preamp, rate));
+        }
+        std::lock_guard<std::mutex> lock(designs_lock);
+        current.store(next.get());
+        designs.emplace_back(std::move(next));
+        // Free the ones which the audio thread can no longer pick up.
+        for(auto d = designs.begin(); d != designs.end();) {
+            if(d->get() != current.load() && d->get() != in_use.load()) {
+                d = designs.erase(d);
+            } else {
+                d += 1;
+            }
+        }
+    }
+    void on_playback_change(boxten::Events, void* param) {
+        auto change = reinterpret_cast<boxten::HookParameters::PlaybackChange*>(param);
+        if(change->old_state == boxten::PlaybackState::STOPPED && change->new_state == boxten::PlaybackState::PLAYING) load();
+    }
+    // The returned design is valid until the next call.
+    const Design* find_design(u32 sampling_rate) {
+        Designs* published;
+        do {
+            published = current.load();
+            in_use.store(published);
+        } while(current.load() != published);
+        for(auto& d : *published) {
+            if(d.sampling_rate == sampling_rate) return &d;
+        }
+        return nullptr;
+    }
+
+  public:
+    boxten::FormatCapabilities get_capabilities() override {
+        boxten::FormatCapabilities capabilities;
+        capabilities.sample_types = {boxten::native_f32};
+        capabilities.sampling_rates.assign(std::begin(sampling_rates), std::end(sampling_rates));
+        return capabilities;
+    }
+    bool is_in_place() override {
+        return true;
+    }
+    bool modify_block(boxten::PCMBlock& block) override {
+        auto& format = block.format;
+        if(format.sample_type != boxten::native_f32 || format.planar || format.channels > max_channels) return false;
+        const auto design = find_design(format.sampling_rate);
+        if(design == nullptr) return false;
+        // After a jump, the state of the old position would ring.
+        if(format.sampling_rate != sampling_rate || format.channels != channels || block.discontinuous) cascade.reset();
+        sampling_rate = format.sampling_rate;
+        channels      = format.channels;
+        cascade.process(reinterpret_cast<f32*>(block.pcm), block.frames, channels, *design);
+        return true;
+    }
+    bool modify_packet(boxten::PCMPacketUnit& packet) override {
+        if(packet.format.get_sample_bytewidth() == 0 || packet.format.channels == 0) return false;
+        boxten::PCMBlock block{packet.format, {packet.original_frame_pos[0], packet.original_frame_pos[1]}, packet.pcm.data(), packet.get_frames(), &packet};
+        return modify_block(block);
+    }
+    Equalizer(void* param) : boxten::SoundProcessor(param) {
+        load();
+        install_eventhook(std::bind(&Equalizer::on_playback_change, this, std::placeholders::_1, std::placeholders::_2), boxten::Events::PLAYBACK_CHANGE);
+    }
+};
+} // namespace eq
+
+BOXTEN_MODULE({"Equalizer", boxten::COMPONENT_TYPE::SOUND_PROCESSOR, CATALOGUE_CALLBACK(eq::Equalizer)})